@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "bench.hpp"
+#include "frontend.hpp"
+
+using namespace ttmandel;
+
+void help(std::string_view program_name) {
+    std::cout << "Usage: " << program_name << " [options] <baseline.json> <new.json>\n";
+    std::cout << "Compares two --bench JSON result files and exits with 1 if any configuration got significantly slower\n";
+    std::cout << "or is missing from the new results.\n";
+    std::cout << "\n";
+    std::cout << "Options:\n";
+    std::cout << "  --threshold <fraction>     Smallest slowdown of the median that counts as a regression. Default is 0.05.\n";
+    std::cout << "  --alpha <p>                Significance level of the one-sided Mann-Whitney test. Default is 0.01.\n";
+    std::cout << "  --allow-missing            Do not fail on configurations of the baseline missing from the new results.\n";
+    std::cout << "  --help                     Display this help message.\n";
+    exit(0);
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+using Key = std::tuple<std::string, std::string, size_t>;
+
+// Samples of every (label, scene, size), pooled over runs
+static std::map<Key, std::vector<double>> load(const std::string& path) {
+    std::map<Key, std::vector<double>> samples;
+    for(const BenchRecord& record : load_bench_results(path)) {
+        std::vector<double>& s = samples[{record.label, record.scene, record.size}];
+        s.insert(s.end(), record.seconds.begin(), record.seconds.end());
+    }
+    return samples;
+}
+
+int main(int argc, char* argv[])
+{
+    double threshold = 0.05;
+    double alpha = 0.01;
+    bool allow_missing = false;
+    std::vector<std::string> files;
+
+    // Quick and dirty argument parsing.
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--threshold") {
+            threshold = std::stod(next_arg(i, argc, argv));
+        } else if (arg == "--alpha") {
+            alpha = std::stod(next_arg(i, argc, argv));
+        } else if (arg == "--allow-missing") {
+            allow_missing = true;
+        } else if (arg == "--help") {
+            help(argv[0]);
+        } else if (!arg.starts_with("--")) {
+            files.emplace_back(arg);
+        } else {
+            std::cout << "Unknown argument: " << arg << std::endl;
+            help(argv[0]);
+        }
+    }
+    if (files.size() != 2) {
+        std::cerr << "Expected a baseline and a new result file" << std::endl;
+        return 1;
+    }
+
+    std::map<Key, std::vector<double>> baseline, current;
+    try {
+        baseline = load(files[0]);
+        current = load(files[1]);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to load results: " << e.what() << std::endl;
+        return 1;
+    }
+
+    int regressions = 0;
+    // A configuration that crashed or was skipped must not pass as "no regression"
+    int missing = 0;
+    int compared = 0;
+    std::cout << std::fixed;
+    for (const auto& [key, base] : baseline) {
+        const auto& [label, scene, size] = key;
+        auto it = current.find(key);
+        std::cout << label << " " << size << "x" << size << " " << scene << ": ";
+        if (it == current.end()) {
+            std::cout << (allow_missing ? "missing from " : "MISSING from ") << files[1] << std::endl;
+            missing++;
+            continue;
+        }
+        const std::vector<double>& next = it->second;
+        const double base_median = median(base);
+        const double next_median = median(next);
+        const double change = next_median / base_median - 1.0;
+        const double p_slower = mann_whitney_greater(base, next);
+        const double p_faster = mann_whitney_greater(next, base);
+        compared++;
+
+        std::cout << std::setprecision(6) << base_median << " s -> " << next_median << " s ("
+                  << std::showpos << std::setprecision(1) << change * 100.0 << std::noshowpos << "%), ";
+        if (change > threshold && p_slower < alpha) {
+            std::cout << "REGRESSION (p = " << std::setprecision(4) << p_slower << ")" << std::endl;
+            regressions++;
+        } else if (change < -threshold && p_faster < alpha) {
+            std::cout << "improved (p = " << std::setprecision(4) << p_faster << ")" << std::endl;
+        } else {
+            std::cout << "no significant change" << std::endl;
+        }
+    }
+    for (const auto& [key, next] : current) {
+        if (!baseline.contains(key)) {
+            const auto& [label, scene, size] = key;
+            std::cout << label << " " << size << "x" << size << " " << scene << ": new, no baseline" << std::endl;
+        }
+    }
+
+    std::cout << regressions << " regressions in " << compared << " comparisons";
+    if (missing) {
+        std::cout << ", " << missing << " missing";
+    }
+    std::cout << std::endl;
+    return regressions || (missing && !allow_missing) ? 1 : 0;
+}
@@ -1,112 +1,179 @@
+#include <algorithm>
 #include <iostream>
-#include <vector>
-#include <cmath>
-#include <cstdint>
-#include <chrono>
-#include <omp.h>
+#include <memory>
+#include <string_view>
 #include <thread>
 
-#include "stb_image_write.h"
-#include "utils.hpp"
+#include "autotune.hpp"
+#include "cpu_backend.hpp"
+#include "frontend.hpp"
+#include "scaling.hpp"
+#include "scenes.hpp"
 
-void help(std::string_view program_name) {
+using namespace ttmandel;
+
+void help(std::string_view program_name, const FrontendOptions& defaults) {
     std::cout << "Usage: " << program_name << " [options]\n";
     std::cout << "This program demonstrates how to add two vectors using tt-Metalium.\n";
     std::cout << "\n";
     std::cout << "Options:\n";
-    std::cout << "  --width, -w <width>        Specify the width of the image. Default is 1024.\n";
-    std::cout << "  --height, -h <height>      Specify the height of the image. Default is 1024.\n";
-    std::cout << "  --output, -o <filename>    Specify the output filename. Default is mandelbrot.png.\n";
-    std::cout << "                             Supported formats: PNG, JPG, BMP.\n";
     std::cout << "  --threads, -t <num_threads> Specify the number of threads to use. Default is auto.\n";
-    std::cout << "  --help                     Display this help message.\n";
+    std::cout << "  --interleave <k>           Pixels each thread iterates at once: 1, 4 or 8. Default is tuned, or 1.\n";
+    std::cout << "  --simd <lanes>             Vectorized escape time kernel with 8 or 16 lanes, 0 for the scalar one.\n";
+    std::cout << "  --no-mirror                Compute both halves of views symmetric about the real axis.\n";
+    std::cout << "  --scaling <size|scene>     Measure strong scaling at size x size (or a catalog scene) and weak\n";
+    std::cout << "                             scaling from there over thread counts, using --warmup and\n";
+    std::cout << "                             --repetitions.\n";
+    std::cout << "  --scaling-threads <list>   Thread counts to sweep, e.g. 1,2,4:32:4. Default is powers of two\n";
+    std::cout << "                             up to every hardware thread.\n";
+    std::cout << "  --scaling-output <file>    CSV file of the scaling results. Default is scaling.csv.\n";
+    std::cout << "  --autotune <scenes>        Search thread count and scheduling on catalog scenes (names or all)\n";
+    std::cout << "                             and save the fastest to the tuning file. Default 1 warmup and 3\n";
+    std::cout << "                             repetitions.\n";
+    std::cout << "  --tuning <file|none>       Tuning file loaded at startup and written by --autotune. Default is\n";
+    std::cout << "                             " << default_tuning_file() << ".\n";
+    print_common_help(defaults);
     exit(0);
 }
 
-std::string next_arg(int& i, int argc, char** argv) {
-    if (i + 1 >= argc) {
-        std::cerr << "Expected argument after " << argv[i] << std::endl;
-        exit(1);
-    }
-    return argv[++i];
-}
-
 int main(int argc, char* argv[])
 {
-    size_t width = 1024;
-    size_t height = 1024;
-
-    float left = -2.0f;
-    float right = 1.0f;
-    float bottom = -1.5f;
-    float top = 1.5f;
-    std::string output_file = "mandelbrot.png";
-    int n_threads = std::thread::hardware_concurrency();
-
-    const int max_iteration = 64;
+    FrontendOptions options;
+    options.output_file = "mandelbrot.png";
+    const FrontendOptions defaults = options;
+    int n_threads = 0;
+    int interleave = 0;
+    int simd_lanes = -1;
+    bool mirror_rows = true;
+    ScalingOptions scaling;
+    bool run_scaling_sweep = false;
+    const Scene* scaling_scene = nullptr;
+    AutotuneOptions autotune;
+    bool run_autotune_search = false;
+    std::string tuning_file = default_tuning_file();
 
     // Quick and dirty argument parsing.
     for (int i = 1; i < argc; i++) {
         std::string_view arg = argv[i];
-        if (arg == "--width" || arg == "-w") {
-            width = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--height" || arg == "-h") {
-            height = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--output" || arg == "-o") {
-            output_file = next_arg(i, argc, argv);
-        } else if (arg == "--threads" || arg == "-t") {
+        if (arg == "--threads" || arg == "-t") {
             n_threads = std::stoi(next_arg(i, argc, argv));
+        } else if (arg == "--interleave") {
+            interleave = std::stoi(next_arg(i, argc, argv));
+        } else if (arg == "--simd") {
+            simd_lanes = std::stoi(next_arg(i, argc, argv));
+        } else if (arg == "--no-mirror") {
+            mirror_rows = false;
+        } else if (arg == "--scaling") {
+            std::string target = next_arg(i, argc, argv);
+            scaling_scene = find_scene(target);
+            if (!scaling_scene) {
+                if (target.empty() || target.find_first_not_of("0123456789") != std::string::npos) {
+                    std::cerr << "Expected an image size or a scene for --scaling, got " << target << std::endl;
+                    exit(1);
+                }
+                scaling.size = std::stoul(target);
+            }
+            run_scaling_sweep = true;
+        } else if (arg == "--scaling-threads") {
+            try {
+                scaling.threads = parse_sizes(next_arg(i, argc, argv));
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid --scaling-threads: " << e.what() << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--scaling-output") {
+            scaling.output_file = next_arg(i, argc, argv);
+        } else if (arg == "--autotune") {
+            try {
+                autotune.scenes = parse_scenes(next_arg(i, argc, argv));
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                exit(1);
+            }
+            run_autotune_search = true;
+        } else if (arg == "--tuning") {
+            tuning_file = next_arg(i, argc, argv);
+            if (tuning_file == "none") {
+                tuning_file.clear();
+            }
+        } else if (parse_common_arg(arg, i, argc, argv, options)) {
+            continue;
         } else if (arg == "--help") {
-            help(argv[0]);
+            help(argv[0], defaults);
             return 0;
         } else {
             std::cout << "Unknown argument: " << arg << std::endl;
-            help(argv[0]);
+            help(argv[0], defaults);
         }
     }
 
+    if (run_autotune_search) {
+        // The search is meant to be short, so only follow --warmup and --repetitions when they were given
+        if (options.bench.warmup != defaults.bench.warmup) {
+            autotune.warmup = options.bench.warmup;
+        }
+        if (options.bench.repetitions != defaults.bench.repetitions) {
+            autotune.repetitions = options.bench.repetitions;
+        }
+        autotune.tuning_file = tuning_file;
+        return run_autotune(autotune);
+    }
 
-    std::vector<int> iterations(width * height);
-    omp_set_num_threads(n_threads);
-
-    auto start = std::chrono::high_resolution_clock::now();
-    #pragma omp parallel for
-    for(size_t y = 0; y < height; ++y) {
-        for(size_t x = 0; x < width; ++x) {
-            float real = left + (right - left) * x / (width - 1);
-            float imag = bottom + (top - bottom) * y / (height - 1);
-
-            float zx = real;
-            float zy = imag;
-            int iteration = 0;
-            while(zx * zx + zy * zy < 4.0f && iteration < max_iteration) {
-                float tmp = zx * zx - zy * zy + real;
-                zy = 2.0f * zx * zy + imag;
-                zx = tmp;
-                ++iteration;
-            }
+    CpuTuning tuning = load_tuning(tuning_file).value_or(CpuTuning{});
+    if (n_threads > 0) {
+        tuning.threads = n_threads;
+    }
+    if (interleave > 0) {
+        tuning.interleave = interleave;
+    }
+    if (simd_lanes >= 0) {
+        tuning.simd_lanes = simd_lanes;
+    }
+    tuning.mirror_rows = mirror_rows;
 
-            iterations[y * width + x] = iteration;
+    if (run_scaling_sweep) {
+        scaling.tuning = tuning;
+        scaling.warmup = options.bench.warmup;
+        scaling.repetitions = options.bench.repetitions;
+        scaling.render = scaling_scene ? scaling_scene->options : options.render;
+        scaling.viewport = scaling_scene ? scaling_scene->viewport
+            : options.viewport.value_or(default_viewport(options.render.fractal));
+        if (scaling_scene) {
+            scaling.size = scaling_scene->options.width;
+        }
+        try {
+            return run_scaling(scaling);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
         }
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Elapsed time: " << elapsed.count() << " seconds" << std::endl;
 
-    std::vector<uint8_t> image(width * height * 3);
-    omp_set_num_threads(std::thread::hardware_concurrency());
-    #pragma omp parallel for
-    for(size_t y = 0; y < height; ++y) {
-        for(size_t x = 0; x < width; ++x) {
-            int iteration = iterations[y * width + x];
-            int max_iteration = 64;
-            map_color((float)iteration/max_iteration, image.data() + y * width * 3 + x * 3);
+    if (options.cluster.spawn_workers > 0) {
+        // Spawned workers share this host, so split its cores between them unless told otherwise
+        int worker_threads = n_threads > 0 ? n_threads
+            : std::max(1, int(std::thread::hardware_concurrency()) / options.cluster.spawn_workers);
+        // Workers render with the same tuning as this process would
+        std::vector<std::string>& args = options.cluster.worker_args;
+        args = {"--threads", std::to_string(worker_threads), "--tuning", tuning_file.empty() ? "none" : tuning_file};
+        if (interleave > 0) {
+            args.insert(args.end(), {"--interleave", std::to_string(interleave)});
+        }
+        if (simd_lanes >= 0) {
+            args.insert(args.end(), {"--simd", std::to_string(simd_lanes)});
+        }
+        if (!mirror_rows) {
+            args.push_back("--no-mirror");
         }
     }
 
-    // Save the image
-    if(!save_image(output_file, width, height, 3, image.data(), width * 3)) {
-        std::cerr << "Failed to save image." << std::endl;
+    std::unique_ptr<CpuBackend> backend;
+    try {
+        backend = std::make_unique<CpuBackend>(tuning);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
-
+    Renderer renderer(std::move(backend));
+    return run_frontend(renderer, options);
 }
@@ -13,8 +13,9 @@
 #include <vector>
 #include <chrono>
 
-#include "stb_image_write.h"
-#include "utils.hpp"
+#include "cost_map.hpp"
+#include "frontend.hpp"
+#include "trace.hpp"
 
 using namespace tt::tt_metal;
 
@@ -49,140 +50,189 @@ CBHandle MakeCircularBufferFP32(Program& program, const CoreSpec& core, tt::CBIn
     return MakeCircularBuffer(program, core, cb, n_tiles * tile_size, tile_size, tt::DataFormat::Float32);
 }
 
-std::string next_arg(int& i, int argc, char** argv) {
-    if (i + 1 >= argc) {
-        std::cerr << "Expected argument after " << argv[i] << std::endl;
-        exit(1);
-    }
-    return argv[++i];
+// The SFPU kernel hardcodes the Mandelbrot iteration and 64 iterations
+void check_options(const ttmandel::RenderOptions& options) {
+    if(options.mode != ttmandel::RenderMode::EscapeTime || options.fractal.type != ttmandel::FractalType::Mandelbrot)
+        throw std::runtime_error("Only escape time Mandelbrot rendering is supported on this device");
+    if(options.max_iteration != 64)
+        throw std::runtime_error("The device kernel is compiled for 64 iterations");
+    if(options.precision != ttmandel::Precision::Single)
+        throw std::runtime_error("Only single precision is supported on this device");
+    if(options.row_offset != 0 || options.image_height != 0)
+        throw std::runtime_error("Bands of a larger image are not supported on this device");
 }
 
-void help(std::string_view program_name) {
+// Renders on every Tensix core, each core generating its own rows of complex numbers. The device, program and
+// output buffer stay alive between renders, so only the first render pays for bring-up and kernel compilation.
+class TtMultiCoreNullaryBackend : public ttmandel::Backend {
+public:
+    explicit TtMultiCoreNullaryBackend(int device_id) {
+        auto start = std::chrono::high_resolution_clock::now();
+        tt::tt_metal::detail::EnablePersistentKernelCache();
+        device = CreateDevice(device_id);
+        device->enable_program_cache();
+
+        core_grid = device->compute_with_storage_grid_size();
+        auto all_cores = CoreRange({0, 0}, {core_grid.x - 1, core_grid.y - 1});
+
+        const uint32_t tiles_per_cb = 4;
+        MakeCircularBufferFP32(program, all_cores, tt::CBIndex::c_0, tiles_per_cb); // Why???
+        // MakeCircularBufferFP32(program, core, tt::CBIndex::c_1, tiles_per_cb);
+        MakeCircularBufferFP32(program, all_cores, tt::CBIndex::c_16, tiles_per_cb);
+
+        writer = CreateKernel(
+            program,
+            "../multi_core_nullary/kernel/tile_write.cpp",
+            all_cores,
+            DataMovementConfig{.processor = DataMovementProcessor::RISCV_1, .noc = NOC::RISCV_1_default});
+        compute = CreateKernel(
+            program,
+            "../multi_core_nullary/kernel/mandelbrot_compute.cpp",
+            all_cores,
+            ComputeConfig{.math_approx_mode = false, .compile_args = {}, .defines = {}});
+        auto end = std::chrono::high_resolution_clock::now();
+        startup_seconds = std::chrono::duration<double>(end - start).count();
+    }
+
+    ~TtMultiCoreNullaryBackend() override {
+        c.reset();
+        CloseDevice(device);
+    }
+
+    std::string name() const override { return "tt_multi_core_nullary"; }
+    bool partial_rows() const override { return false; }
+    // Readback of c; coordinates are generated on the device
+    size_t host_bytes(const ttmandel::RenderOptions& options) const override {
+        return sizeof(float) * options.width * options.height;
+    }
+
+    void render(const ttmandel::Viewport& viewport, const ttmandel::RenderOptions& options,
+        size_t row_begin, size_t row_end, ttmandel::Frame& frame) override {
+        check_options(options);
+        auto setup_start = std::chrono::high_resolution_clock::now();
+        const size_t width = options.width;
+        const size_t height = options.height;
+
+        const uint32_t tile_size = TILE_WIDTH * TILE_HEIGHT;
+        if(width % tile_size != 0)
+            throw std::runtime_error("Invalid dimensions, width must be divisible by tile_size");
+        const uint32_t n_tiles = (width * height) / tile_size;
+        if(n_tiles != allocated_tiles) {
+            c = MakeBuffer(device, n_tiles, sizeof(float));
+            allocated_tiles = n_tiles;
+        }
+        auto setup_end = std::chrono::high_resolution_clock::now();
+        frame.setup_seconds = startup_seconds + std::chrono::duration<double>(setup_end - setup_start).count();
+        startup_seconds = 0.0;
+
+        CommandQueue& cq = device->command_queue();
+
+        uint32_t params[4];
+        float p[4] = {float(viewport.left), float(viewport.right), float(viewport.bottom), float(viewport.top)};
+        memcpy(params, p, sizeof(p));
+
+        uint32_t num_cores = core_grid.x * core_grid.y;
+        uint32_t height_chunk = height / num_cores + (height % num_cores != 0);
+        // Cores are not timed, but their row split is what the cost map has to show
+        if(options.cost)
+            options.cost->workers = num_cores;
+        for(uint32_t i=0; i<num_cores; ++i) {
+            uint32_t x = i % core_grid.x;
+            uint32_t y = i / core_grid.x;
+            CoreCoord core(x, y);
+
+            uint32_t start_row = std::min(i * height_chunk, uint32_t(height));
+            uint32_t end_row = std::min(start_row + height_chunk, uint32_t(height));
+
+            if(options.cost) {
+                for(uint32_t row = start_row; row < end_row; ++row)
+                    options.cost->rows[row].worker = i;
+            }
+
+            SetRuntimeArgs(program, writer, core, {c->address(), start_row, end_row, uint32_t(width / tile_size)});
+            SetRuntimeArgs(program, compute, core, {params[0], params[1], params[2], params[3], uint32_t(width), uint32_t(height), start_row, end_row});
+        }
+
+        Finish(cq);
+        if(!compiled) {
+            TRACE_ZONE("compile");
+            auto compile_start = std::chrono::high_resolution_clock::now();
+            EnqueueProgram(cq, program, true); // Run it a 1st time to get the compiler out of the way
+            compiled = true;
+            auto compile_end = std::chrono::high_resolution_clock::now();
+            frame.setup_seconds += std::chrono::duration<double>(compile_end - compile_start).count();
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            TRACE_ZONE("device_compute");
+            EnqueueProgram(cq, program, true);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        frame.compute_seconds = std::chrono::duration<double>(end - start).count();
+
+        TRACE_ZONE("readback");
+        auto readback_start = std::chrono::high_resolution_clock::now();
+        EnqueueReadBuffer(cq, c, c_data, true);
+        host_buffers.set(c_data.capacity() * sizeof(float));
+        #pragma omp parallel for
+        for(size_t i = 0; i < width * height; ++i) {
+            frame.iterations[i] = int32_t(c_data[i]);
+        }
+        auto readback_end = std::chrono::high_resolution_clock::now();
+        frame.readback_seconds = std::chrono::duration<double>(readback_end - readback_start).count();
+    }
+
+private:
+    IDevice* device = nullptr;
+    Program program = CreateProgram();
+    CoreCoord core_grid;
+    KernelHandle writer = 0;
+    KernelHandle compute = 0;
+    std::shared_ptr<Buffer> c;
+    uint32_t allocated_tiles = 0;
+    bool compiled = false;
+    // Device bring-up in the constructor, reported as setup time of the first render
+    double startup_seconds = 0.0;
+    std::vector<float> c_data;
+    TrackedBytes host_buffers{MemoryClass::Device};
+};
+
+void help(std::string_view program_name, const ttmandel::FrontendOptions& defaults) {
     std::cout << "Usage: " << program_name << " [options]\n";
     std::cout << "This program demonstrates how to add two vectors using tt-Metalium.\n";
     std::cout << "\n";
     std::cout << "Options:\n";
     std::cout << "  --device, -d <device_id>   Specify the device to run the program on. Default is 0.\n";
     std::cout << "  --seed, -s <seed>          Specify the seed for the random number generator. Default is random.\n";
-    std::cout << "  --width, -w <width>        Specify the width of the image. Default is 1024.\n";
-    std::cout << "  --height, -h <height>      Specify the height of the image. Default is 1024.\n";
-    std::cout << "  --output, -o <output_file> Specify the output file name. Default is mandelbrot_tt_multi_core_nullary.png.\n";
-    std::cout << "                             Supported formats: PNG, JPG, BMP.\n";
-    std::cout << "  --help                     Display this help message.\n";
+    ttmandel::print_common_help(defaults);
     exit(0);
 }
 
 int main(int argc, char** argv) {
     int seed = std::random_device{}();
     int device_id = 0;
-    size_t width = 1024;
-    size_t height = 1024;
-    std::string output_file = "mandelbrot_tt_multi_core_nullary.png";
+    ttmandel::FrontendOptions options;
+    options.output_file = "mandelbrot_tt_multi_core_nullary.png";
+    const ttmandel::FrontendOptions defaults = options;
 
     // Quick and dirty argument parsing.
     for (int i = 1; i < argc; i++) {
         std::string_view arg = argv[i];
         if (arg == "--device" || arg == "-d") {
-            device_id = std::stoi(next_arg(i, argc, argv));
+            device_id = std::stoi(ttmandel::next_arg(i, argc, argv));
         } else if (arg == "--seed" || arg == "-s") {
-            seed = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--width" || arg == "-w") {
-            width = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--height" || arg == "-h") {
-            height = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--output" || arg == "-o") {
-            output_file = next_arg(i, argc, argv);
-        } else if (arg == "--help" || arg == "-h") {
-            help(argv[0]);
+            seed = std::stoi(ttmandel::next_arg(i, argc, argv));
+        } else if (ttmandel::parse_common_arg(arg, i, argc, argv, options)) {
+            continue;
+        } else if (arg == "--help") {
+            help(argv[0], defaults);
             return 0;
         } else {
             std::cout << "Unknown argument: " << arg << std::endl;
-            help(argv[0]);
-        }
-    }
-
-    tt::tt_metal::detail::EnablePersistentKernelCache();
-    IDevice* device = CreateDevice(device_id);
-    device->enable_program_cache();
-
-    Program program = CreateProgram();
-    auto core_grid = device->compute_with_storage_grid_size();
-    auto all_cores = CoreRange({0, 0}, {core_grid.x - 1, core_grid.y - 1});
-
-    CommandQueue& cq = device->command_queue();
-
-    const float left = -2.0f;
-    const float right = 1.0f;
-    const float bottom = -1.5f;
-    const float top = 1.5f;
-
-    const uint32_t tile_size = TILE_WIDTH * TILE_HEIGHT;
-    if(width % tile_size != 0)
-        throw std::runtime_error("Invalid dimensions, width must be divisible by tile_size");
-    const uint32_t n_tiles = (width * height) / tile_size;
-    auto c = MakeBuffer(device, n_tiles, sizeof(float));
-
-    const uint32_t tiles_per_cb = 4;
-    CBHandle cb_a = MakeCircularBufferFP32(program, all_cores, tt::CBIndex::c_0, tiles_per_cb); // Why???
-    // CBHandle cb_b = MakeCircularBufferFP32(program, core, tt::CBIndex::c_1, tiles_per_cb);
-    CBHandle cb_c = MakeCircularBufferFP32(program, all_cores, tt::CBIndex::c_16, tiles_per_cb);
-
-    auto writer = CreateKernel(
-        program,
-        "../multi_core_nullary/kernel/tile_write.cpp",
-        all_cores,
-        DataMovementConfig{.processor = DataMovementProcessor::RISCV_1, .noc = NOC::RISCV_1_default});
-    auto compute = CreateKernel(
-        program,
-        "../multi_core_nullary/kernel/mandelbrot_compute.cpp",
-        all_cores,
-        ComputeConfig{.math_approx_mode = false, .compile_args = {}, .defines = {}});
-
-    // SetRuntimeArgs(program, reader, core, {a->address(), b->address(), n_tiles});
-    uint32_t params[4];
-    float p[4] = {left, right, bottom, top};
-    memcpy(params, p, sizeof(p));
-
-    uint32_t num_cores = core_grid.x * core_grid.y;
-    uint32_t height_chunk = height / num_cores + (height % num_cores != 0);
-    for(uint32_t i=0; i<num_cores; ++i) {
-        uint32_t x = i % core_grid.x;
-        uint32_t y = i / core_grid.x;
-        CoreCoord core(x, y);
-
-        uint32_t start_row = i * height_chunk;
-        uint32_t end_row = std::min(start_row + height_chunk, uint32_t(height));
-
-        SetRuntimeArgs(program, writer, core, {c->address(), start_row, end_row, uint32_t(width / tile_size)});
-        SetRuntimeArgs(program, compute, core, {params[0], params[1], params[2], params[3], uint32_t(width), uint32_t(height), start_row, end_row});
-    }
-
-    Finish(cq);
-    EnqueueProgram(cq, program, true); // Run it a 1st time to get the compiler out of the way
-    auto start = std::chrono::high_resolution_clock::now();
-    EnqueueProgram(cq, program, true);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Elapsed time: " << elapsed.count() << " seconds" << std::endl;
-
-    std::vector<float> c_data;
-    EnqueueReadBuffer(cq, c, c_data, true);
-    float* c_bf16 = reinterpret_cast<float*>(c_data.data());
-
-    std::vector<uint8_t> image(width * height * 3);
-    #pragma omp parallel for
-    for(size_t y = 0; y < height; ++y) {
-        for(size_t x = 0; x < width; ++x) {
-            float iteration = c_bf16[y * width + x];
-            constexpr int max_iteration = 64;
-            map_color(iteration/max_iteration, image.data() + y * width * 3 + x * 3);
+            help(argv[0], defaults);
         }
     }
-    if(!save_image("mandelbrot_tt_multi_core_nullary.png", width, height, 3, image.data(), width * 3)) {
-        std::cerr << "Failed to save image." << std::endl;
-    }
 
-    // Finally, we close the device.
-    CloseDevice(device);
-    return 0;
+    ttmandel::Renderer renderer(std::make_unique<TtMultiCoreNullaryBackend>(device_id));
+    return ttmandel::run_frontend(renderer, options);
 }
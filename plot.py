@@ -1,12 +1,43 @@
+import json
+import sys
+
 import pandas as pd
 import seaborn as sns
 import matplotlib.pyplot as plt
 
-df = pd.read_csv('benchmark.csv', index_col=0)
+# Reads the JSON lines written by --bench (the benchmark target writes build/benchmark.json)
+path = sys.argv[1] if len(sys.argv) > 1 else 'build/benchmark.json'
+with open(path) as f:
+    runs = [json.loads(line) for line in f if line.strip()]
+df = pd.DataFrame([dict(label=run['label'], **result) for run in runs for result in run['results']])
 
 sns.set_style("darkgrid")
-# plt.yscale('log')
 
-plt.title('Time to render mandelbrot set')
-sns.lineplot(data=df, x='size', y='time', hue='executable')
+scenes = df[df['scene'].notna()]
+sizes = df[df['scene'].isna()]
+panels = [p for p in (scenes, sizes) if not p.empty]
+fig, axes = plt.subplots(1, len(panels), figsize=(7 * len(panels), 5), squeeze=False)
+ax = iter(axes[0])
+
+if not scenes.empty:
+    # Catalog scenes differ by orders of magnitude, so compare throughput rather than time
+    scenes = scenes.assign(giter_per_second=scenes['iterations'] / scenes['median'] / 1e9)
+    a = next(ax)
+    sns.barplot(data=scenes, x='scene', y='giter_per_second', hue='label', ax=a)
+    a.set_title('Scene catalog throughput (median)')
+    a.set_ylabel('Giter/s')
+
+if not sizes.empty:
+    a = next(ax)
+    # a.set_yscale('log')
+    a.set_title('Time to render mandelbrot set (median, 95% CI)')
+    for label, group in sizes.groupby('label'):
+        group = group.sort_values('size')
+        line, = a.plot(group['size'], group['median'], marker='o', label=label)
+        a.fill_between(group['size'], group['ci_low'], group['ci_high'], color=line.get_color(), alpha=0.25)
+    a.set_xlabel('size')
+    a.set_ylabel('time (s)')
+    a.legend()
+
+plt.tight_layout()
 plt.show()
@@ -0,0 +1,28 @@
+import sys
+
+import pandas as pd
+import seaborn as sns
+import matplotlib.pyplot as plt
+
+# Reads the CSV written by cpu --scaling
+path = sys.argv[1] if len(sys.argv) > 1 else 'build/scaling.csv'
+df = pd.read_csv(path)
+
+sns.set_style("darkgrid")
+fig, (speedup, efficiency, serial) = plt.subplots(1, 3, figsize=(15, 4.5))
+fig.suptitle('CPU thread scaling')
+
+threads = sorted(df['threads'].unique())
+speedup.plot(threads, threads, 'k--', label='ideal')
+sns.lineplot(data=df, x='threads', y='speedup', hue='kind', marker='o', ax=speedup)
+speedup.set_title('Speedup (weak: scaled)')
+
+sns.lineplot(data=df, x='threads', y='efficiency', hue='kind', marker='o', ax=efficiency)
+efficiency.set_ylim(0, 1.1)
+efficiency.set_title('Parallel efficiency')
+
+sns.lineplot(data=df[df['threads'] > 1], x='threads', y='karp_flatt', hue='kind', marker='o', ax=serial)
+serial.set_title('Karp-Flatt serial fraction')
+
+plt.tight_layout()
+plt.show()
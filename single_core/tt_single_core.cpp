@@ -12,8 +12,8 @@
 #include <vector>
 #include <chrono>
 
-#include "stb_image_write.h"
-#include "utils.hpp"
+#include "frontend.hpp"
+#include "trace.hpp"
 
 using namespace tt::tt_metal;
 
@@ -48,145 +48,197 @@ CBHandle MakeCircularBufferFP32(Program& program, const CoreSpec& core, tt::CBIn
     return MakeCircularBuffer(program, core, cb, n_tiles * tile_size, tile_size, tt::DataFormat::Float32);
 }
 
-std::string next_arg(int& i, int argc, char** argv) {
-    if (i + 1 >= argc) {
-        std::cerr << "Expected argument after " << argv[i] << std::endl;
-        exit(1);
-    }
-    return argv[++i];
+// The SFPU kernel hardcodes the Mandelbrot iteration and 64 iterations
+void check_options(const ttmandel::RenderOptions& options) {
+    if(options.mode != ttmandel::RenderMode::EscapeTime || options.fractal.type != ttmandel::FractalType::Mandelbrot)
+        throw std::runtime_error("Only escape time Mandelbrot rendering is supported on this device");
+    if(options.max_iteration != 64)
+        throw std::runtime_error("The device kernel is compiled for 64 iterations");
+    if(options.precision != ttmandel::Precision::Single)
+        throw std::runtime_error("Only single precision is supported on this device");
+    if(options.row_offset != 0 || options.image_height != 0)
+        throw std::runtime_error("Bands of a larger image are not supported on this device");
 }
 
-void help(std::string_view program_name) {
+// Renders on a single Tensix core, streaming the real and imaginary parts of every pixel in from DRAM. The device,
+// program and buffers stay alive between renders, so only the first render pays for bring-up and kernel compilation.
+class TtSingleCoreBackend : public ttmandel::Backend {
+public:
+    explicit TtSingleCoreBackend(int device_id) {
+        auto start = std::chrono::high_resolution_clock::now();
+        // tt::tt_metal::detail::EnablePersistentKernelCache();
+        device = CreateDevice(device_id);
+        device->enable_program_cache();
+
+        const uint32_t tiles_per_cb = 4;
+        // Create 3 circular buffers. These will be used by the data movement kernels to stream data into the compute cores
+        // and for the compute cores to stream data out.
+        MakeCircularBufferFP32(program, core, tt::CBIndex::c_0, tiles_per_cb);
+        MakeCircularBufferFP32(program, core, tt::CBIndex::c_1, tiles_per_cb);
+        MakeCircularBufferFP32(program, core, tt::CBIndex::c_16, tiles_per_cb);
+
+        reader = CreateKernel(
+            program,
+            "../single_core/kernel/interleaved_tile_read.cpp",
+            core,
+            DataMovementConfig{.processor = DataMovementProcessor::RISCV_0, .noc = NOC::RISCV_0_default});
+        writer = CreateKernel(
+            program,
+            "../single_core/kernel/tile_write.cpp",
+            core,
+            DataMovementConfig{.processor = DataMovementProcessor::RISCV_1, .noc = NOC::RISCV_1_default});
+        compute = CreateKernel(
+            program,
+            "../single_core/kernel/mandelbrot_compute.cpp",
+            core,
+            ComputeConfig{.math_approx_mode = false, .compile_args = {}, .defines = {}});
+        auto end = std::chrono::high_resolution_clock::now();
+        startup_seconds = std::chrono::duration<double>(end - start).count();
+    }
+
+    ~TtSingleCoreBackend() override {
+        a.reset();
+        b.reset();
+        c.reset();
+        CloseDevice(device);
+    }
+
+    std::string name() const override { return "tt_single_core"; }
+    bool partial_rows() const override { return false; }
+    // Coordinate staging for a and b plus the readback of c, all float
+    size_t host_bytes(const ttmandel::RenderOptions& options) const override {
+        return 3 * sizeof(float) * options.width * options.height;
+    }
+
+    void render(const ttmandel::Viewport& viewport, const ttmandel::RenderOptions& options,
+        size_t row_begin, size_t row_end, ttmandel::Frame& frame) override {
+        check_options(options);
+        auto setup_start = std::chrono::high_resolution_clock::now();
+        const size_t width = options.width;
+        const size_t height = options.height;
+
+        const uint32_t tile_size = TILE_WIDTH * TILE_HEIGHT;
+        if((width * height) % tile_size != 0)
+            throw std::runtime_error("Invalid dimensions, width * height must be divisible by tile_size");
+        const uint32_t n_tiles = (width * height) / tile_size;
+        if(n_tiles != allocated_tiles) {
+            a = MakeBuffer(device, n_tiles, sizeof(float));
+            b = MakeBuffer(device, n_tiles, sizeof(float));
+            c = MakeBuffer(device, n_tiles, sizeof(float));
+            allocated_tiles = n_tiles;
+        }
+        auto setup_end = std::chrono::high_resolution_clock::now();
+        frame.setup_seconds = startup_seconds + std::chrono::duration<double>(setup_end - setup_start).count();
+        startup_seconds = 0.0;
+
+        CommandQueue& cq = device->command_queue();
+
+        auto coordinate_start = std::chrono::high_resolution_clock::now();
+        const float left = viewport.left;
+        const float right = viewport.right;
+        const float bottom = viewport.bottom;
+        const float top = viewport.top;
+        a_data.resize(width * height);
+        b_data.resize(width * height);
+        for(size_t y = 0; y < height; y++) {
+            for(size_t x = 0; x < width; x++) {
+                float real = left + (right - left) * x / width;
+                float imag = bottom + (top - bottom) * y / height;
+                a_data[y * width + x] = real;
+                b_data[y * width + x] = imag;
+            }
+        }
+
+        EnqueueWriteBuffer(cq, a, a_data, false);
+        EnqueueWriteBuffer(cq, b, b_data, false);
+
+        SetRuntimeArgs(program, reader, core, {a->address(), b->address(), n_tiles});
+        SetRuntimeArgs(program, writer, core, {c->address(), n_tiles});
+        SetRuntimeArgs(program, compute, core, {n_tiles});
+
+        Finish(cq);
+        auto coordinate_end = std::chrono::high_resolution_clock::now();
+        frame.coordinate_seconds = std::chrono::duration<double>(coordinate_end - coordinate_start).count();
+        if(!compiled) {
+            TRACE_ZONE("compile");
+            auto compile_start = std::chrono::high_resolution_clock::now();
+            EnqueueProgram(cq, program, true); // Run it a 1st time to get the compiler out of the way
+            compiled = true;
+            auto compile_end = std::chrono::high_resolution_clock::now();
+            frame.setup_seconds += std::chrono::duration<double>(compile_end - compile_start).count();
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            TRACE_ZONE("device_compute");
+            EnqueueProgram(cq, program, true);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        frame.compute_seconds = std::chrono::duration<double>(end - start).count();
+
+        TRACE_ZONE("readback");
+        auto readback_start = std::chrono::high_resolution_clock::now();
+        EnqueueReadBuffer(cq, c, c_data, true);
+        host_buffers.set((a_data.capacity() + b_data.capacity() + c_data.capacity()) * sizeof(float));
+        #pragma omp parallel for
+        for(size_t i = 0; i < width * height; ++i) {
+            frame.iterations[i] = int32_t(c_data[i]);
+        }
+        auto readback_end = std::chrono::high_resolution_clock::now();
+        frame.readback_seconds = std::chrono::duration<double>(readback_end - readback_start).count();
+    }
+
+private:
+    static constexpr CoreCoord core = {0, 0};
+    IDevice* device = nullptr;
+    Program program = CreateProgram();
+    KernelHandle reader = 0;
+    KernelHandle writer = 0;
+    KernelHandle compute = 0;
+    std::shared_ptr<Buffer> a;
+    std::shared_ptr<Buffer> b;
+    std::shared_ptr<Buffer> c;
+    uint32_t allocated_tiles = 0;
+    bool compiled = false;
+    // Device bring-up in the constructor, reported as setup time of the first render
+    double startup_seconds = 0.0;
+    std::vector<float> a_data;
+    std::vector<float> b_data;
+    std::vector<float> c_data;
+    TrackedBytes host_buffers{MemoryClass::Device};
+};
+
+void help(std::string_view program_name, const ttmandel::FrontendOptions& defaults) {
     std::cout << "Usage: " << program_name << " [options]\n";
     std::cout << "This program demonstrates how to add two vectors using tt-Metalium.\n";
     std::cout << "\n";
     std::cout << "Options:\n";
     std::cout << "  --device, -d <device_id>   Specify the device to run the program on. Default is 0.\n";
-    std::cout << "  --width, -w <width>        Specify the width of the image. Default is 1024.\n";
-    std::cout << "  --height, -h <height>      Specify the height of the image. Default is 1024.\n";
-    std::cout << "  --output, -o <output_file> Specify the output file. Default is mandelbrot_tt_single_core.png.\n";
-    std::cout << "                             Supported formats: PNG, JPG, BMP.\n";
-    std::cout << "  --help                     Display this help message.\n";
-
+    ttmandel::print_common_help(defaults);
     exit(0);
 }
 
 int main(int argc, char** argv) {
     int device_id = 0;
-    size_t width = 1024;
-    size_t height = 1024;
-    std::string output_file = "mandelbrot_tt_single_core.png";
-
-    const float left = -2.0f;
-    const float right = 1.0f;
-    const float bottom = -1.5f;
-    const float top = 1.5f;
+    ttmandel::FrontendOptions options;
+    options.output_file = "mandelbrot_tt_single_core.png";
+    const ttmandel::FrontendOptions defaults = options;
 
     // Quick and dirty argument parsing.
     for (int i = 1; i < argc; i++) {
         std::string_view arg = argv[i];
         if (arg == "--device" || arg == "-d") {
-            device_id = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--width" || arg == "-w") {
-            width = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--height" || arg == "-h") {
-            height = std::stoi(next_arg(i, argc, argv));
-        } else if (arg == "--output" || arg == "-o") {
-            output_file = next_arg(i, argc, argv);
+            device_id = std::stoi(ttmandel::next_arg(i, argc, argv));
+        } else if (ttmandel::parse_common_arg(arg, i, argc, argv, options)) {
+            continue;
         } else if (arg == "--help") {
-            help(argv[0]);
+            help(argv[0], defaults);
             return 0;
         } else {
             std::cout << "Unknown argument: " << arg << std::endl;
-            help(argv[0]);
+            help(argv[0], defaults);
         }
     }
 
-    // tt::tt_metal::detail::EnablePersistentKernelCache();
-    IDevice* device = CreateDevice(device_id);
-    device->enable_program_cache();
-
-    Program program = CreateProgram();
-    constexpr CoreCoord core = {0, 0};
-
-    CommandQueue& cq = device->command_queue();
-
-    std::vector<float> a_data(width * height);
-    std::vector<float> b_data(width * height);
-
-    const uint32_t tile_size = TILE_WIDTH * TILE_HEIGHT;
-    if((width * height) % tile_size != 0)
-        throw std::runtime_error("Invalid dimensions, width * height must be divisible by tile_size");
-    const uint32_t n_tiles = (width * height) / tile_size;
-    auto a = MakeBuffer(device, n_tiles, sizeof(float));
-    auto b = MakeBuffer(device, n_tiles, sizeof(float));
-    auto c = MakeBuffer(device, n_tiles, sizeof(float));
-
-    for(size_t y = 0; y < height; y++) {
-        for(size_t x = 0; x < width; x++) {
-            float real = left + (right - left) * x / width;
-            float imag = bottom + (top - bottom) * y / height;
-            a_data[y * width + x] = real;
-            b_data[y * width + x] = imag;
-        }
-    }
-
-    const uint32_t tiles_per_cb = 4;
-    // Create 3 circular buffers. These will be used by the data movement kernels to stream data into the compute cores
-    // and for the compute cores to stream data out.
-    CBHandle cb_a = MakeCircularBufferFP32(program, core, tt::CBIndex::c_0, tiles_per_cb);
-    CBHandle cb_b = MakeCircularBufferFP32(program, core, tt::CBIndex::c_1, tiles_per_cb);
-    CBHandle cb_c = MakeCircularBufferFP32(program, core, tt::CBIndex::c_16, tiles_per_cb);
-
-    EnqueueWriteBuffer(cq, a, a_data, false);
-    EnqueueWriteBuffer(cq, b, b_data, false);
-
-    auto reader = CreateKernel(
-        program,
-        "../single_core/kernel/interleaved_tile_read.cpp",
-        core,
-        DataMovementConfig{.processor = DataMovementProcessor::RISCV_0, .noc = NOC::RISCV_0_default});
-    auto writer = CreateKernel(
-        program,
-        "../single_core/kernel/tile_write.cpp",
-        core,
-        DataMovementConfig{.processor = DataMovementProcessor::RISCV_1, .noc = NOC::RISCV_1_default});
-    auto compute = CreateKernel(
-        program,
-        "../single_core/kernel/mandelbrot_compute.cpp",
-        core,
-        ComputeConfig{.math_approx_mode = false, .compile_args = {}, .defines = {}});
-
-    SetRuntimeArgs(program, reader, core, {a->address(), b->address(), n_tiles});
-    SetRuntimeArgs(program, writer, core, {c->address(), n_tiles});
-    SetRuntimeArgs(program, compute, core, {n_tiles});
-
-    Finish(cq);
-    EnqueueProgram(cq, program, true); // Run it a 1st time to get the compiler out of the way
-    auto start = std::chrono::high_resolution_clock::now();
-    EnqueueProgram(cq, program, true);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Elapsed time: " << elapsed.count() << " seconds" << std::endl;
-
-    std::vector<float> c_data;
-    EnqueueReadBuffer(cq, c, c_data, true);
-    float* c_bf16 = reinterpret_cast<float*>(c_data.data());
-
-    std::vector<uint8_t> image(width * height * 3);
-    #pragma omp parallel for
-    for(size_t y = 0; y < height; ++y) {
-        for(size_t x = 0; x < width; ++x) {
-            float iteration = c_bf16[y * width + x];
-            constexpr int max_iteration = 64;
-            map_color(iteration/max_iteration, image.data() + y * width * 3 + x * 3);
-        }
-    }
-    if(!save_image(output_file, width, height, 3, image.data(), width * 3)) {
-        std::cerr << "Failed to save image." << std::endl;
-    }
-
-    // Finally, we close the device.
-    CloseDevice(device);
-    return 0;
+    ttmandel::Renderer renderer(std::make_unique<TtSingleCoreBackend>(device_id));
+    return ttmandel::run_frontend(renderer, options);
 }
@@ -0,0 +1,161 @@
+#include "autotune.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include <yaml-cpp/yaml.h>
+
+#include "bench.hpp"
+#include "scenes.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+// One tuning parameter and the values the search tries for it
+struct Dimension {
+    const char* name;
+    int CpuTuning::* field;
+    std::vector<int> values;
+};
+
+std::vector<Dimension> search_space() {
+    const int hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> threads = {hardware};
+    // Leaving SMT siblings idle wins when the FMA ports are already saturated by one thread per core
+    if(physical_cores() != hardware)
+        threads.push_back(physical_cores());
+    return {
+        {"threads", &CpuTuning::threads, threads},
+        {"chunk_rows", &CpuTuning::chunk_rows, {0, 1, 4, 16}},
+        {"interleave", &CpuTuning::interleave, {1, 4, 8}},
+        {"simd_lanes", &CpuTuning::simd_lanes, {0, 8, 16}},
+    };
+}
+
+std::string describe(const CpuTuning& tuning) {
+    std::string out;
+    for(const Dimension& dimension : search_space())
+        out += (out.empty() ? "" : ", ") + std::string(dimension.name) + " " + std::to_string(tuning.*dimension.field);
+    return out;
+}
+
+// Geometric mean of the median compute time of every workload, so long scenes do not drown out short ones
+double score(const CpuTuning& tuning, const std::vector<Workload>& workloads, const AutotuneOptions& options) {
+    Renderer renderer(std::make_unique<CpuBackend>(tuning));
+    double log_sum = 0.0;
+    for(const Workload& workload : workloads)
+        log_sum += std::log(summarize(time_renders(renderer, workload, options.warmup, options.repetitions)).median);
+    return std::exp(log_sum / workloads.size());
+}
+
+}
+
+std::string default_tuning_file() {
+    std::filesystem::path dir;
+    if(const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache)
+        dir = cache;
+    else if(const char* home = std::getenv("HOME"); home && *home)
+        dir = std::filesystem::path(home) / ".cache";
+    else
+        return "";
+    return dir / "ttmandel" / ("tuning-" + host_info().hostname + ".yaml");
+}
+
+std::optional<CpuTuning> load_tuning(const std::string& path) {
+    if(path.empty() || !std::filesystem::exists(path))
+        return std::nullopt;
+    try {
+        YAML::Node root = YAML::LoadFile(path);
+        const HostInfo host = host_info();
+        if(root["cpu_model"].as<std::string>("") != host.cpu_model
+            || root["build_flags"].as<std::string>("") != host.build_flags) {
+            std::cerr << "Ignoring " << path << ", it was tuned for another CPU or build. Run cpu --autotune again."
+                      << std::endl;
+            return std::nullopt;
+        }
+        CpuTuning tuning;
+        for(const Dimension& dimension : search_space())
+            tuning.*dimension.field = root[dimension.name].as<int>(tuning.*dimension.field);
+        return tuning;
+    } catch(const YAML::Exception& e) {
+        std::cerr << "Ignoring " << path << ": " << e.what() << std::endl;
+        return std::nullopt;
+    }
+}
+
+void save_tuning(const std::string& path, const CpuTuning& tuning) {
+    const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if(!parent.empty())
+        std::filesystem::create_directories(parent);
+    const HostInfo host = host_info();
+    YAML::Node root;
+    root["host"] = host.hostname;
+    root["cpu_model"] = host.cpu_model;
+    root["build_flags"] = host.build_flags;
+    for(const Dimension& dimension : search_space())
+        root[dimension.name] = tuning.*dimension.field;
+    std::ofstream out(path);
+    out << "# Written by cpu --autotune\n" << root << "\n";
+    if(!out)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+int run_autotune(const AutotuneOptions& options) {
+    if(options.tuning_file.empty()) {
+        std::cerr << "No tuning file: set HOME or XDG_CACHE_HOME, or pass --tuning <file>" << std::endl;
+        return 1;
+    }
+    BenchOptions bench;
+    bench.scenes = options.scenes;
+    const std::vector<Workload> workloads = bench_workloads(bench);
+
+    const HostInfo host = host_info();
+    std::cout << "Host: " << host.cpu_model << ", " << host.cores << " threads" << std::endl;
+
+    const std::vector<Dimension> space = search_space();
+    CpuTuning best;
+    best.threads = space[0].values[0];
+    std::map<std::vector<int>, double> scores;
+    auto measure = [&](const CpuTuning& tuning) {
+        std::vector<int> key;
+        for(const Dimension& dimension : space)
+            key.push_back(tuning.*dimension.field);
+        auto it = scores.find(key);
+        if(it != scores.end())
+            return it->second;
+        const double seconds = score(tuning, workloads, options);
+        std::cout << describe(tuning) << ": " << seconds << " s" << std::endl;
+        return scores[key] = seconds;
+    };
+
+    const double baseline = measure(best);
+    double best_seconds = baseline;
+    for(const Dimension& dimension : space) {
+        CpuTuning candidate = best;
+        for(int value : dimension.values) {
+            candidate.*dimension.field = value;
+            const double seconds = measure(candidate);
+            if(seconds < best_seconds) {
+                best_seconds = seconds;
+                best = candidate;
+            }
+        }
+    }
+
+    std::cout << "Best: " << describe(best) << ", " << baseline / best_seconds << "x the speed of the defaults"
+              << std::endl;
+    save_tuning(options.tuning_file, best);
+    std::cout << "Saved to " << options.tuning_file << std::endl;
+    return 0;
+}
+
+}
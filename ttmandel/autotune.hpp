@@ -0,0 +1,35 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cpu_backend.hpp"
+
+namespace ttmandel {
+
+struct Scene;
+
+struct AutotuneOptions {
+    // Scenes every candidate is timed on
+    std::vector<const Scene*> scenes;
+    int warmup = 1;
+    int repetitions = 3;
+    // Where the winner is saved
+    std::string tuning_file;
+};
+
+// $XDG_CACHE_HOME/ttmandel/tuning-<hostname>.yaml, or under ~/.cache. The host name keeps nodes sharing a home
+// directory from overwriting each other's tuning.
+std::string default_tuning_file();
+
+// The tuning saved in `path`, or nullopt when there is none or it was tuned on another CPU model or build
+std::optional<CpuTuning> load_tuning(const std::string& path);
+void save_tuning(const std::string& path, const CpuTuning& tuning);
+
+// Searches the CPU tuning parameters one at a time, keeping the best value of each before moving to the next, and
+// saves the fastest configuration. A candidate's score is the geometric mean of its median time over the scenes.
+// Returns the process exit code.
+int run_autotune(const AutotuneOptions& options);
+
+}
@@ -0,0 +1,436 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/utsname.h>
+#include <yaml-cpp/yaml.h>
+#include <unistd.h>
+
+#include "energy.hpp"
+#include "frontend.hpp"
+#include "report.hpp"
+#include "scenes.hpp"
+
+#ifndef TTMANDEL_BUILD_FLAGS
+#define TTMANDEL_BUILD_FLAGS "unknown"
+#endif
+
+namespace ttmandel {
+
+namespace {
+
+double median_of_sorted(const std::vector<double>& sorted) {
+    const size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
+
+double median_of(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return median_of_sorted(values);
+}
+
+std::string read_line(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line.empty() ? "unknown" : line;
+}
+
+std::string csv_field(const std::string& s) {
+    if(s.find_first_of(",\"") == std::string::npos)
+        return s;
+    std::string out = "\"";
+    for(char c : s) {
+        if(c == '"')
+            out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+struct Result {
+    Workload workload;
+    std::vector<double> seconds;
+    SampleStats stats;
+    // Iterations of one render, the same for every repetition
+    std::optional<uint64_t> iterations;
+    // Whether the frame matched the scene's reference checksum
+    std::optional<bool> checksum_ok;
+    // Median energy of one render, when RAPL is readable
+    std::optional<double> joules;
+};
+
+void write_csv(const std::string& path, const std::string& label, const HostInfo& host,
+    const std::vector<Result>& results) {
+    const bool exists = std::filesystem::exists(path);
+    std::ofstream out(path, std::ios::app);
+    if(!exists) {
+        out << "label,scene,size,max_iter,mode,fractal,precision,samples,kept,median,mad,ci_low,ci_high,mean,min,max,"
+               "giter_per_second,mpixel_per_second,joules_per_frame,pixels_per_joule,checksum_ok,"
+               "hostname,cpu_model,cores,governor,kernel,compiler,"
+               "build_flags\n";
+    }
+    for(const Result& r : results) {
+        const SampleStats& s = r.stats;
+        const RenderOptions& o = r.workload.render;
+        const double pixels = double(o.width) * o.height;
+        out << csv_field(label) << ',' << (r.workload.scene ? r.workload.scene->name : "") << ',' << o.width << ','
+            << o.max_iteration << ',' << render_mode_name(o.mode) << ',' << fractal_type_name(o.fractal.type) << ','
+            << precision_name(o.precision) << ','
+            << s.samples << ',' << s.kept << ',' << s.median << ',' << s.mad << ',' << s.ci_low << ','
+            << s.ci_high << ',' << s.mean << ',' << s.min << ',' << s.max << ','
+            << (r.iterations ? double(*r.iterations) / s.median / 1e9 : 0.0) << ',' << pixels / s.median / 1e6 << ','
+            << (r.joules ? std::to_string(*r.joules) : "") << ','
+            << (r.joules && *r.joules > 0.0 ? std::to_string(pixels / *r.joules) : "") << ','
+            << (r.checksum_ok ? (*r.checksum_ok ? "true" : "false") : "") << ','
+            << csv_field(host.hostname) << ',' << csv_field(host.cpu_model) << ',' << host.cores << ','
+            << csv_field(host.governor) << ',' << csv_field(host.kernel) << ',' << csv_field(host.compiler) << ','
+            << csv_field(host.build_flags) << '\n';
+    }
+    if(!out)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+void write_json(const std::string& path, const BenchOptions& options, const std::string& label, const HostInfo& host,
+    const std::vector<Result>& results) {
+    std::ofstream out(path, std::ios::app);
+    out << "{\"label\": " << json_string(label)
+        << ", \"host\": {\"hostname\": " << json_string(host.hostname)
+        << ", \"cpu_model\": " << json_string(host.cpu_model)
+        << ", \"cores\": " << host.cores
+        << ", \"governor\": " << json_string(host.governor)
+        << ", \"kernel\": " << json_string(host.kernel)
+        << ", \"compiler\": " << json_string(host.compiler)
+        << ", \"build_flags\": " << json_string(host.build_flags) << "}"
+        << ", \"config\": {\"warmup\": " << options.warmup
+        << ", \"repetitions\": " << options.repetitions << "}"
+        << ", \"results\": [";
+    for(size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        const SampleStats& s = r.stats;
+        const RenderOptions& o = r.workload.render;
+        const Viewport& v = r.workload.viewport;
+        const std::streamsize precision = out.precision();
+        out << (i ? ", " : "") << "{\"scene\": ";
+        if(r.workload.scene)
+            out << json_string(r.workload.scene->name);
+        else
+            out << "null";
+        out << ", \"size\": " << o.width
+            << ", \"max_iter\": " << o.max_iteration
+            << ", \"mode\": " << json_string(render_mode_name(o.mode))
+            << ", \"fractal\": " << json_string(fractal_type_name(o.fractal.type))
+            << ", \"precision\": " << json_string(precision_name(o.precision))
+            // bench_compare tells views apart by this, so it needs every digit
+            << std::setprecision(std::numeric_limits<double>::max_digits10)
+            << ", \"viewport\": [" << v.left << ", " << v.right << ", " << v.bottom << ", " << v.top << "]"
+            << std::setprecision(precision)
+            << ", \"kept\": " << s.kept
+            << ", \"median\": " << s.median
+            << ", \"mad\": " << s.mad
+            << ", \"ci_low\": " << s.ci_low
+            << ", \"ci_high\": " << s.ci_high
+            << ", \"mean\": " << s.mean
+            << ", \"min\": " << s.min
+            << ", \"max\": " << s.max
+            << ", \"iterations\": ";
+        if(r.iterations)
+            out << *r.iterations;
+        else
+            out << "null";
+        out << ", \"joules_per_frame\": ";
+        if(r.joules)
+            out << *r.joules;
+        else
+            out << "null";
+        out << ", \"checksum_ok\": " << (r.checksum_ok ? (*r.checksum_ok ? "true" : "false") : "null");
+        out << ", \"seconds\": [";
+        for(size_t j = 0; j < r.seconds.size(); ++j)
+            out << (j ? ", " : "") << r.seconds[j];
+        out << "]}";
+    }
+    out << "]}\n";
+    if(!out)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+}
+
+SampleStats summarize(std::vector<double> samples) {
+    SampleStats stats;
+    stats.samples = samples.size();
+    if(samples.empty())
+        return stats;
+
+    std::sort(samples.begin(), samples.end());
+    const double median = median_of_sorted(samples);
+    std::vector<double> deviations(samples.size());
+    for(size_t i = 0; i < samples.size(); ++i)
+        deviations[i] = std::abs(samples[i] - median);
+    // 1.4826 turns the MAD into a standard deviation estimate for normal data
+    const double limit = 3.0 * 1.4826 * median_of(deviations);
+    if(limit > 0.0) {
+        std::erase_if(samples, [&](double s) { return std::abs(s - median) > limit; });
+    }
+
+    const size_t n = samples.size();
+    stats.kept = n;
+    stats.median = median_of_sorted(samples);
+    for(size_t i = 0; i < n; ++i)
+        deviations[i] = std::abs(samples[i] - stats.median);
+    deviations.resize(n);
+    stats.mad = median_of(deviations);
+    stats.min = samples.front();
+    stats.max = samples.back();
+    double sum = 0.0;
+    for(double s : samples)
+        sum += s;
+    stats.mean = sum / n;
+    // The rank of the median is Binomial(n, 1/2); its normal approximation gives the ranks bracketing 95%
+    const double half_width = 1.96 * std::sqrt(double(n)) / 2.0;
+    const double low = std::floor(n / 2.0 - half_width);
+    const double high = std::ceil(n / 2.0 + half_width);
+    stats.ci_low = samples[size_t(std::max(0.0, low))];
+    stats.ci_high = samples[size_t(std::min(double(n - 1), high))];
+    return stats;
+}
+
+HostInfo host_info() {
+    HostInfo host;
+    char hostname[256] = {};
+    gethostname(hostname, sizeof(hostname) - 1);
+    host.hostname = hostname;
+
+    host.cpu_model = "unknown";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while(std::getline(cpuinfo, line)) {
+        if(line.starts_with("model name")) {
+            size_t colon = line.find(':');
+            if(colon != std::string::npos && colon + 2 <= line.size())
+                host.cpu_model = line.substr(colon + 2);
+            break;
+        }
+    }
+    host.cores = std::thread::hardware_concurrency();
+    host.governor = read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+
+    utsname uts;
+    host.kernel = uname(&uts) == 0 ? std::string(uts.sysname) + " " + uts.release : "unknown";
+#if defined(__clang__)
+    host.compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    host.compiler = "gcc " __VERSION__;
+#else
+    host.compiler = "unknown";
+#endif
+    host.build_flags = TTMANDEL_BUILD_FLAGS;
+    return host;
+}
+
+static size_t parse_size(const std::string& text) {
+    if(text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+        throw std::runtime_error("Expected a number, got '" + text + "'");
+    return std::stoul(text);
+}
+
+std::vector<size_t> parse_sizes(const std::string& list) {
+    std::vector<size_t> sizes;
+    size_t pos = 0;
+    while(pos <= list.size()) {
+        size_t comma = std::min(list.find(',', pos), list.size());
+        const std::string item = list.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        size_t colon = item.find(':');
+        if(colon == std::string::npos) {
+            sizes.push_back(parse_size(item));
+            continue;
+        }
+        size_t second = item.find(':', colon + 1);
+        if(second == std::string::npos)
+            throw std::runtime_error("Expected first:last:step, got " + item);
+        size_t first = parse_size(item.substr(0, colon));
+        size_t last = parse_size(item.substr(colon + 1, second - colon - 1));
+        size_t step = parse_size(item.substr(second + 1));
+        if(step == 0)
+            throw std::runtime_error("Size step must be positive");
+        for(size_t size = first; size <= last; size += step)
+            sizes.push_back(size);
+    }
+    return sizes;
+}
+
+double mann_whitney_greater(const std::vector<double>& base, const std::vector<double>& next) {
+    const size_t n1 = base.size();
+    const size_t n2 = next.size();
+    if(n1 == 0 || n2 == 0)
+        return 1.0;
+    double u = 0.0;
+    for(double b : base) {
+        for(double x : next)
+            u += x > b ? 1.0 : x == b ? 0.5 : 0.0;
+    }
+
+    // Normal approximation, with the variance corrected for tied samples
+    std::vector<double> all(base);
+    all.insert(all.end(), next.begin(), next.end());
+    std::sort(all.begin(), all.end());
+    const double n = double(n1 + n2);
+    double ties = 0.0;
+    for(size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while(j < all.size() && all[j] == all[i])
+            ++j;
+        const double t = double(j - i);
+        ties += t * t * t - t;
+        i = j;
+    }
+    const double variance = double(n1) * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+    if(variance <= 0.0)
+        return 1.0;
+    // Continuity correction towards the null hypothesis
+    const double z = (u - double(n1) * n2 / 2.0 - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+std::vector<BenchRecord> load_bench_results(const std::string& path) {
+    std::ifstream file(path);
+    if(!file)
+        throw std::runtime_error("Cannot open " + path);
+    std::vector<BenchRecord> records;
+    std::string line;
+    while(std::getline(file, line)) {
+        if(line.empty())
+            continue;
+        // JSON is a subset of YAML's flow style
+        YAML::Node run = YAML::Load(line);
+        for(const YAML::Node& result : run["results"]) {
+            BenchRecord record;
+            record.label = run["label"].as<std::string>();
+            // Catalog scenes by name, other views by their settings
+            if(result["scene"] && !result["scene"].IsNull()) {
+                record.scene = result["scene"].as<std::string>();
+            } else {
+                const YAML::Node& v = result["viewport"];
+                record.scene = result["fractal"].as<std::string>() + " " + result["mode"].as<std::string>() + " "
+                    + result["precision"].as<std::string>() + " max_iter " + result["max_iter"].as<std::string>()
+                    + " [" + v[0].as<std::string>() + "," + v[1].as<std::string>() + "," + v[2].as<std::string>()
+                    + "," + v[3].as<std::string>() + "]";
+            }
+            record.size = result["size"].as<size_t>();
+            record.seconds = result["seconds"].as<std::vector<double>>();
+            records.push_back(std::move(record));
+        }
+    }
+    return records;
+}
+
+std::string Workload::name() const {
+    const std::string size = std::to_string(render.width) + "x" + std::to_string(render.height);
+    return scene ? scene->name + " " + size : size;
+}
+
+std::vector<Workload> bench_workloads(const BenchOptions& options) {
+    std::vector<Workload> workloads;
+    for(const Scene* scene : options.scenes)
+        workloads.push_back({scene, scene->options, scene->viewport});
+    for(size_t size : options.sizes) {
+        Workload workload{nullptr, options.render, options.viewport};
+        workload.render.width = size;
+        workload.render.height = size;
+        workloads.push_back(workload);
+    }
+    return workloads;
+}
+
+std::vector<double> time_renders(Renderer& renderer, const Workload& workload, int warmup, int repetitions,
+    std::vector<double>* joules) {
+    std::vector<double> seconds;
+    RenderOptions options = workload.render;
+    const bool measure_energy = joules && energy_unavailable_reason().empty();
+    for(int i = 0; i < warmup + repetitions; ++i) {
+        EnergyProfile energy;
+        if(measure_energy)
+            options.energy = &energy;
+        const Frame& frame = renderer.render(workload.viewport, options);
+        if(i < warmup)
+            continue;
+        seconds.push_back(frame.compute_seconds);
+        if(std::optional<EnergyValues> total = energy.total())
+            joules->push_back(total->total());
+    }
+    return seconds;
+}
+
+int run_benchmark(Renderer& renderer, const BenchOptions& options) {
+    const std::string label = options.label.empty() ? renderer.backend().name() : options.label;
+    const HostInfo host = host_info();
+    std::cout << "Host: " << host.cpu_model << ", " << host.cores << " threads, governor " << host.governor
+              << std::endl;
+    if(host.governor != "performance" && host.governor != "unknown")
+        std::cout << "Warning: the " << host.governor << " governor adds clock ramp-up noise to short renders"
+                  << std::endl;
+
+    std::vector<Result> results;
+    int mismatches = 0;
+    for(const Workload& workload : bench_workloads(options)) {
+        Result result;
+        result.workload = workload;
+        std::vector<double> joules;
+        try {
+            result.seconds = time_renders(renderer, workload, options.warmup, options.repetitions, &joules);
+        } catch(const std::runtime_error& e) {
+            // e.g. a device backend that cannot render the scene's fractal, precision or max_iter
+            std::cout << label << " " << workload.name() << ": skipped, " << e.what() << std::endl;
+            continue;
+        }
+        const Frame& frame = renderer.frame();
+        result.iterations = frame.executed_iterations;
+        if(workload.scene)
+            result.checksum_ok = frame_checksum(frame) == workload.scene->checksum;
+        result.stats = summarize(result.seconds);
+        if(!joules.empty())
+            result.joules = summarize(joules).median;
+
+        const SampleStats& s = result.stats;
+        std::cout << label << " " << workload.name() << ": median " << s.median << " s, MAD " << s.mad
+                  << " s, 95% CI [" << s.ci_low << ", " << s.ci_high << "], " << s.kept << "/" << s.samples
+                  << " kept";
+        if(result.joules)
+            std::cout << ", " << *result.joules << " J/frame";
+        if(result.checksum_ok && !*result.checksum_ok) {
+            std::cout << ", CHECKSUM MISMATCH";
+            mismatches++;
+        }
+        std::cout << std::endl;
+        results.push_back(std::move(result));
+    }
+
+    try {
+        if(options.output_file.ends_with(".json"))
+            write_json(options.output_file, options, label, host, results);
+        else
+            write_csv(options.output_file, label, host, results);
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    // A faster kernel that computes different images is a failure, not a speedup
+    if(mismatches && !options.allow_mismatch) {
+        std::cerr << mismatches << " workloads did not match their scene checksum" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+}
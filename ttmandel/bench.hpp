@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct Scene;
+
+struct BenchOptions {
+    // Catalog scenes to render, each at its own size and settings
+    std::vector<const Scene*> scenes;
+    // Square sizes of `viewport` with `render` settings to render, after the scenes
+    std::vector<size_t> sizes;
+    int warmup = 2;
+    int repetitions = 10;
+    // Results are appended so several executables can share one file: a JSON document with every sample per line
+    // for .json, CSV rows (with a header for a new file) otherwise
+    std::string output_file = "benchmark.csv";
+    // Name of the configuration in the results, the backend name when empty
+    std::string label;
+    // Exit with 0 even when frames do not match the scene checksums, for backends that are known to differ
+    bool allow_mismatch = false;
+    RenderOptions render;
+    Viewport viewport;
+};
+
+struct SampleStats {
+    size_t samples = 0;
+    // Samples left after outlier rejection, which the rest is computed from
+    size_t kept = 0;
+    double median = 0.0;
+    // Median absolute deviation from the median, unscaled
+    double mad = 0.0;
+    // 95% confidence interval of the median
+    double ci_low = 0.0;
+    double ci_high = 0.0;
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+};
+
+// Drops samples more than 3 scaled MADs (~3 standard deviations for normal noise) away from the median, then
+// summarizes the rest. The confidence interval comes from order statistics, so it holds for skewed timings too.
+SampleStats summarize(std::vector<double> samples);
+
+// Where the numbers came from, recorded with every result
+struct HostInfo {
+    std::string hostname;
+    std::string cpu_model;
+    unsigned cores = 0;
+    std::string governor;
+    std::string kernel;
+    std::string compiler;
+    std::string build_flags;
+};
+
+HostInfo host_info();
+
+// Parses a comma separated list of sizes and first:last:step ranges, e.g. "512,1024:4096:1024"
+std::vector<size_t> parse_sizes(const std::string& list);
+
+// One-sided Mann-Whitney U test: the p-value of seeing samples this much larger in `next` if both came from the same
+// distribution. Uses the normal approximation, which is reasonable from ~8 samples each.
+double mann_whitney_greater(const std::vector<double>& base, const std::vector<double>& next);
+
+// One size of one run in a JSON bench file
+struct BenchRecord {
+    std::string label;
+    // Catalog scene name, or the fractal, mode, precision, max_iter and viewport of the run
+    std::string scene;
+    size_t size = 0;
+    std::vector<double> seconds;
+};
+
+std::vector<BenchRecord> load_bench_results(const std::string& path);
+
+// One thing to render: a catalog scene, or a size of the configured view
+struct Workload {
+    const Scene* scene = nullptr;
+    RenderOptions render;
+    Viewport viewport;
+
+    // "seahorse-valley 1024x1024" or "2048x2048"
+    std::string name() const;
+};
+
+// The scenes, then the sizes of `options`
+std::vector<Workload> bench_workloads(const BenchOptions& options);
+
+// Renders `workload` warmup + repetitions times and returns the compute time of each repetition. The last frame is
+// left in the renderer. Throws what the backend throws for settings it does not support. When `joules` is set and
+// RAPL is readable, the energy of each repetition is appended to it.
+std::vector<double> time_renders(Renderer& renderer, const Workload& workload, int warmup, int repetitions,
+    std::vector<double>* joules = nullptr);
+
+// Renders each scene and size warmup + repetitions times in this process and records the compute time of the
+// repetitions, checking scenes against their reference checksum. Scenes the backend cannot render are skipped.
+// Returns the process exit code.
+int run_benchmark(Renderer& renderer, const BenchOptions& options);
+
+}
@@ -0,0 +1,190 @@
+#include "cost_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+#include "utils.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+// Black to red to yellow to white
+void heat_color(float t, uint8_t* color) {
+    t = std::clamp(t, 0.0f, 1.0f) * 3.0f;
+    color[0] = uint8_t(std::min(t, 1.0f) * 255.0f);
+    color[1] = uint8_t(std::clamp(t - 1.0f, 0.0f, 1.0f) * 255.0f);
+    color[2] = uint8_t(std::clamp(t - 2.0f, 0.0f, 1.0f) * 255.0f);
+}
+
+void worker_color(int worker, uint8_t* color) {
+    static const uint8_t palette[8][3] = {
+        {31, 119, 180}, {255, 127, 14}, {44, 160, 44}, {214, 39, 40},
+        {148, 103, 189}, {140, 86, 75}, {227, 119, 194}, {127, 127, 127},
+    };
+    std::copy(palette[worker % 8], palette[worker % 8] + 3, color);
+}
+
+bool write_csv(const std::string& path, const CostMap& cost) {
+    std::ofstream out(path);
+    out << "row,worker,iterations,seconds\n";
+    for(size_t y = 0; y < cost.rows.size(); ++y) {
+        const RowCost& row = cost.rows[y];
+        out << y << ',' << row.worker << ',' << row.iterations << ',';
+        if(!std::isnan(row.seconds))
+            out << row.seconds;
+        out << '\n';
+    }
+    return bool(out);
+}
+
+bool write_heatmap(const std::string& path, const CostMap& cost, const Frame& frame) {
+    constexpr size_t max_width = 1024;
+    constexpr size_t stripe = 16;
+    const size_t block = std::max<size_t>(1, (frame.width + max_width - 1) / max_width);
+    const size_t map_width = (frame.width + block - 1) / block;
+    const size_t map_height = (frame.height + block - 1) / block;
+    const size_t width = map_width + 2 * stripe;
+    std::vector<uint8_t> rgb(width * map_height * 3, 0);
+
+    const bool per_pixel = frame.mode == RenderMode::EscapeTime && !frame.iterations.empty();
+    uint64_t max_row_iterations = 0;
+    std::vector<double> row_seconds;
+    for(const RowCost& row : cost.rows) {
+        if(!std::isnan(row.seconds))
+            row_seconds.push_back(row.seconds);
+        max_row_iterations = std::max(max_row_iterations, row.iterations);
+    }
+    // Scaled to the 99th percentile so a few preempted rows do not wash out the rest
+    double max_row_seconds = 0.0;
+    if(!row_seconds.empty()) {
+        auto p99 = row_seconds.begin() + row_seconds.size() * 99 / 100;
+        std::nth_element(row_seconds.begin(), p99, row_seconds.end());
+        max_row_seconds = *p99;
+    }
+
+    #pragma omp parallel for
+    for(size_t by = 0; by < map_height; ++by) {
+        const size_t y0 = by * block;
+        const size_t y1 = std::min(y0 + block, frame.height);
+        uint8_t* line = rgb.data() + by * width * 3;
+        for(size_t bx = 0; bx < map_width; ++bx) {
+            float t = 0.0f;
+            if(per_pixel) {
+                const size_t x0 = bx * block;
+                const size_t x1 = std::min(x0 + block, frame.width);
+                uint64_t sum = 0;
+                for(size_t y = y0; y < y1; ++y) {
+                    for(size_t x = x0; x < x1; ++x)
+                        sum += frame.iterations[y * frame.width + x];
+                }
+                t = float(double(sum) / ((y1 - y0) * (x1 - x0)) / frame.max_iteration);
+            } else if(max_row_iterations > 0) {
+                uint64_t sum = 0;
+                for(size_t y = y0; y < y1; ++y)
+                    sum += cost.rows[y].iterations;
+                t = float(double(sum) / (y1 - y0) / max_row_iterations);
+            }
+            heat_color(t, line + bx * 3);
+        }
+
+        double seconds = 0.0;
+        for(size_t y = y0; y < y1; ++y)
+            seconds += std::isnan(cost.rows[y].seconds) ? 0.0 : cost.rows[y].seconds;
+        uint8_t time_color[3];
+        heat_color(max_row_seconds > 0.0 ? float(seconds / (y1 - y0) / max_row_seconds) : 0.0f, time_color);
+        uint8_t owner_color[3];
+        worker_color(cost.rows[y0].worker, owner_color);
+        for(size_t x = 0; x < stripe; ++x) {
+            std::copy(time_color, time_color + 3, line + (map_width + x) * 3);
+            std::copy(owner_color, owner_color + 3, line + (map_width + stripe + x) * 3);
+        }
+    }
+    return write_png(path.c_str(), width, map_height, 3, rgb.data(), width * 3);
+}
+
+}
+
+Imbalance analyze(const CostMap& cost) {
+    Imbalance result;
+    result.workers = cost.workers;
+    result.busy_seconds.assign(cost.workers, 0.0);
+    result.iterations.assign(cost.workers, 0);
+    for(const RowCost& row : cost.rows) {
+        if(row.worker < 0 || row.worker >= cost.workers)
+            continue;
+        result.busy_seconds[row.worker] += row.seconds;
+        result.iterations[row.worker] += row.iterations;
+    }
+
+    double total_seconds = 0.0;
+    uint64_t total_iterations = 0;
+    for(int w = 0; w < cost.workers; ++w) {
+        total_seconds += result.busy_seconds[w];
+        total_iterations += result.iterations[w];
+        if(result.busy_seconds[w] > result.busy_seconds[result.critical_worker])
+            result.critical_worker = w;
+    }
+    const uint64_t max_iterations = *std::max_element(result.iterations.begin(), result.iterations.end());
+    result.iteration_imbalance = total_iterations ? double(max_iterations) * cost.workers / total_iterations : 1.0;
+    // NaN propagates through the sums when rows were not timed
+    result.critical_path_seconds = result.busy_seconds[result.critical_worker];
+    result.ideal_seconds = total_seconds / cost.workers;
+    result.time_imbalance = result.critical_path_seconds / result.ideal_seconds;
+    if(std::isnan(total_seconds)) {
+        // Without timings the iteration counts are the best estimate of where the time went
+        uint64_t busiest = 0;
+        for(int w = 0; w < cost.workers; ++w) {
+            if(result.iterations[w] > busiest) {
+                busiest = result.iterations[w];
+                result.critical_worker = w;
+            }
+        }
+    }
+    return result;
+}
+
+void print_imbalance(std::ostream& out, const Imbalance& imbalance) {
+    const bool timed = !std::isnan(imbalance.ideal_seconds);
+    const std::streamsize precision = out.precision();
+    out << "Load balance over " << imbalance.workers << " workers:\n";
+    out << "  iterations max/mean: " << std::fixed << std::setprecision(3) << imbalance.iteration_imbalance << "\n";
+    if(timed) {
+        out << "  busy time max/mean:  " << imbalance.time_imbalance << "\n";
+        out << "  critical path:       " << std::setprecision(6) << imbalance.critical_path_seconds
+            << " s (worker " << imbalance.critical_worker << "), perfect split " << imbalance.ideal_seconds << " s\n";
+    } else {
+        out << "  rows were not timed, busiest worker by iterations: " << imbalance.critical_worker << "\n";
+    }
+    out << std::defaultfloat << std::setprecision(precision);
+}
+
+void write_json(std::ostream& out, const Imbalance& imbalance) {
+    const bool timed = !std::isnan(imbalance.ideal_seconds);
+    auto number = [&](double v) -> std::ostream& { return timed ? out << v : out << "null"; };
+    out << "{\"workers\": " << imbalance.workers
+        << ", \"iteration_imbalance\": " << imbalance.iteration_imbalance
+        << ", \"time_imbalance\": ";
+    number(imbalance.time_imbalance) << ", \"critical_path_seconds\": ";
+    number(imbalance.critical_path_seconds) << ", \"ideal_seconds\": ";
+    number(imbalance.ideal_seconds) << ", \"critical_worker\": " << imbalance.critical_worker
+        << ", \"worker_iterations\": [";
+    for(size_t w = 0; w < imbalance.iterations.size(); ++w)
+        out << (w ? ", " : "") << imbalance.iterations[w];
+    out << "], \"worker_seconds\": [";
+    for(size_t w = 0; w < imbalance.busy_seconds.size(); ++w) {
+        out << (w ? ", " : "");
+        number(imbalance.busy_seconds[w]);
+    }
+    out << "]}";
+}
+
+bool write_cost_map(const std::string& path, const CostMap& cost, const Frame& frame) {
+    if(path.ends_with(".png"))
+        return write_heatmap(path, cost, frame);
+    return write_csv(path, cost);
+}
+
+}
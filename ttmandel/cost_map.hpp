@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct RowCost {
+    uint64_t iterations = 0;
+    // Wall time spent on the row, NaN when the backend cannot time rows
+    double seconds = std::numeric_limits<double>::quiet_NaN();
+    // Thread, core or other unit of parallelism that rendered the row
+    int worker = 0;
+};
+
+// Where the work of a render went, row by row, for load balance analysis. Renderer sizes it when
+// RenderOptions::cost points at one; backends record what they can, and Renderer derives per-row iterations from
+// escape time frames when the backend did not count them.
+struct CostMap {
+    std::vector<RowCost> rows;
+    int workers = 1;
+    bool iterations_recorded = false;
+};
+
+struct Imbalance {
+    int workers = 0;
+    // Per worker totals; busy time is NaN when rows were not timed
+    std::vector<double> busy_seconds;
+    std::vector<uint64_t> iterations;
+    // max / mean over workers, 1 is perfect balance
+    double time_imbalance = 0.0;
+    double iteration_imbalance = 0.0;
+    // Busiest worker's time, which bounds the render, and what a perfect split would take
+    double critical_path_seconds = 0.0;
+    double ideal_seconds = 0.0;
+    int critical_worker = 0;
+};
+
+Imbalance analyze(const CostMap& cost);
+void print_imbalance(std::ostream& out, const Imbalance& imbalance);
+void write_json(std::ostream& out, const Imbalance& imbalance);
+
+// Writes `cost` as CSV (row,worker,iterations,seconds) or, for .png paths, as a heatmap: iterations per block of
+// pixels (per row in distance mode), with per-row time and worker stripes on the right.
+bool write_cost_map(const std::string& path, const CostMap& cost, const Frame& frame);
+
+}
@@ -0,0 +1,127 @@
+#include "cpu_backend.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include <omp.h>
+
+#include "cpu_kernels.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+// Maximum clock of cpu0, from cpufreq or else the current clock in /proc/cpuinfo. 0 when neither is readable.
+double max_clock_ghz() {
+    std::ifstream cpufreq("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq");
+    double khz = 0.0;
+    if(cpufreq >> khz && khz > 0.0)
+        return khz / 1e6;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while(std::getline(cpuinfo, line)) {
+        if(line.starts_with("cpu MHz")) {
+            size_t colon = line.find(':');
+            if(colon != std::string::npos)
+                return std::stod(line.substr(colon + 1)) / 1e3;
+        }
+    }
+    return 0.0;
+}
+
+// Single precision flops per cycle and core: two FMA ports, each doing 2 flops per lane
+int flops_per_cycle() {
+#if defined(__x86_64__)
+    if(__builtin_cpu_supports("avx512f"))
+        return 2 * 2 * 16;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return 2 * 2 * 8;
+    if(__builtin_cpu_supports("avx"))
+        return 2 * 8;
+    return 2 * 4;
+#elif defined(__aarch64__)
+    return 2 * 2 * 4;
+#else
+    return 0;
+#endif
+}
+
+// Hardware threads per core, from the topology of cpu0
+int smt_width() {
+    std::ifstream siblings("/sys/devices/system/cpu/cpu0/topology/thread_siblings_list");
+    std::string list;
+    if(!(siblings >> list))
+        return 1;
+    // "0,64" or "0-1" both mean two siblings; a single number means no SMT
+    return list.find_first_of(",-") == std::string::npos ? 1 : 2;
+}
+
+}
+
+int physical_cores() {
+    return std::max(1u, std::thread::hardware_concurrency() / smt_width());
+}
+
+CpuBackend::CpuBackend(int n_threads)
+    : CpuBackend(CpuTuning{.threads = n_threads}) {}
+
+CpuBackend::CpuBackend(const CpuTuning& tuning)
+    : n_threads_(tuning.threads > 0 ? tuning.threads : std::thread::hardware_concurrency()), tuning_(tuning) {
+    if(tuning.interleave != 1 && tuning.interleave != 4 && tuning.interleave != 8)
+        throw std::runtime_error("Interleave must be 1, 4 or 8, not " + std::to_string(tuning.interleave));
+    if(tuning.simd_lanes != 0 && tuning.simd_lanes != 8 && tuning.simd_lanes != 16)
+        throw std::runtime_error("SIMD lanes must be 0, 8 or 16, not " + std::to_string(tuning.simd_lanes));
+    peak_gflops_ = std::min(n_threads_, physical_cores()) * max_clock_ghz() * flops_per_cycle();
+}
+
+void CpuBackend::render(const Viewport& viewport, const RenderOptions& options,
+    size_t row_begin, size_t row_end, Frame& frame) {
+    TRACE_ZONE("compute");
+    if(options.cost) {
+        options.cost->workers = n_threads_;
+        options.cost->iterations_recorded = true;
+    }
+
+    // The kernels' loops use schedule(runtime), which reads this
+    if(tuning_.chunk_rows > 0)
+        omp_set_schedule(omp_sched_dynamic, tuning_.chunk_rows);
+    else
+        omp_set_schedule(omp_sched_static, 0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto run = [&](const auto& map) {
+        with_fractal(options.fractal, [&](const auto& f) {
+            const RowPlan plan = plan_rows(map, tuning_.mirror_rows && f.conjugate_symmetric(), row_begin, row_end);
+            if(options.mode == RenderMode::Distance) {
+                if constexpr (std::decay_t<decltype(f)>::has_derivative) {
+                    frame.executed_iterations =
+                        distance_estimate(f, map, options, plan.compute, n_threads_, frame.distance.data());
+                    mirror_rows(plan, map.width, n_threads_, options.cost, frame.distance.data());
+                } else {
+                    throw std::runtime_error("Distance estimation is not supported for this fractal");
+                }
+            }
+            else {
+                uint64_t lane_slots = 0;
+                frame.executed_iterations = escape_time(f, map, options, plan.compute, n_threads_, tuning_,
+                    frame.iterations.data(), lane_slots);
+                if(tuning_.simd_lanes > 0)
+                    frame.lane_slots = lane_slots;
+                mirror_rows(plan, map.width, n_threads_, options.cost, frame.iterations.data());
+            }
+        });
+    };
+    if(options.precision == Precision::Double)
+        run(PixelMap<double>(viewport, options));
+    else
+        run(PixelMap<float>(viewport, options));
+    auto end = std::chrono::high_resolution_clock::now();
+    frame.compute_seconds = std::chrono::duration<double>(end - start).count();
+}
+
+}
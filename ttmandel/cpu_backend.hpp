@@ -0,0 +1,51 @@
+#pragma once
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+// Scheduler parameters of the CPU kernels. The defaults are what the kernels did before they could be tuned;
+// `cpu --autotune` searches for better ones per host.
+struct CpuTuning {
+    // <= 0 uses every hardware thread
+    int threads = 0;
+    // Rows handed out per dynamically scheduled chunk, 0 for static contiguous blocks of rows
+    int chunk_rows = 0;
+    // Pixels each thread iterates at once in escape time mode: 1 (one after the other), 4 or 8
+    int interleave = 1;
+    // Lanes of the vectorized escape time kernel, 8 or 16. 0 keeps the scalar loops; otherwise interleave is ignored.
+    int simd_lanes = 0;
+    // Copy rows that are mirror images of computed ones across the real axis instead of computing them
+    bool mirror_rows = true;
+};
+
+// Multi-threaded CPU reference backend. OpenMP keeps its worker threads alive between parallel regions, so a
+// long-lived CpuBackend does not pay thread start-up on every render.
+class CpuBackend : public Backend {
+public:
+    // n_threads <= 0 uses every hardware thread
+    explicit CpuBackend(int n_threads = 0);
+    explicit CpuBackend(const CpuTuning& tuning);
+
+    std::string name() const override { return "cpu"; }
+    void render(const Viewport& viewport, const RenderOptions& options,
+        size_t row_begin, size_t row_end, Frame& frame) override;
+
+    // Vector lanes x FMA ports x 2 x max clock of every thread in use, not counting SMT siblings twice
+    double peak_gflops(Precision precision) const override {
+        return precision == Precision::Double ? peak_gflops_ / 2 : peak_gflops_;
+    }
+
+    int threads() const { return n_threads_; }
+
+private:
+    int n_threads_;
+    CpuTuning tuning_;
+    // Single precision
+    double peak_gflops_;
+};
+
+// Hardware threads that are not SMT siblings of each other
+int physical_cores();
+
+}
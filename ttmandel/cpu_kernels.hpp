@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+#include "cost_map.hpp"
+#include "cpu_backend.hpp"
+#include "perf_counters.hpp"
+#include "renderer.hpp"
+#include "trace.hpp"
+
+namespace ttmandel {
+
+// Squared escape radius used by the distance estimator. A radius larger than the escape time kernel's 2 makes
+// |z|·log|z|/|dz| more accurate, but every doubling of log|R| costs an extra iteration on every exterior pixel.
+// 8 keeps the estimate clean while staying within ~1.5x the cost of escape time rendering.
+constexpr float distance_bailout = 8.0f * 8.0f;
+
+// Pixel to complex plane mapping, in the same precision the kernels iterate in.
+template <typename Real>
+struct PixelMap {
+    size_t width;
+    size_t height;
+    size_t row_offset;
+    Real left;
+    Real right;
+    Real bottom;
+    Real top;
+
+    PixelMap(const Viewport& viewport, const RenderOptions& options)
+        : width(options.width), height(options.image_height ? options.image_height : options.height),
+          row_offset(options.row_offset),
+          left(viewport.left), right(viewport.right), bottom(viewport.bottom), top(viewport.top) {}
+
+    Real real(size_t x) const { return left + (right - left) * x / (width - 1); }
+    Real imag(size_t y) const { return bottom + (top - bottom) * (y + row_offset) / (height - 1); }
+};
+
+// Rows of a render split into the ones the kernels compute and the ones copied from their mirror image
+struct RowPlan {
+    std::vector<size_t> compute;
+    // (row, computed row it mirrors)
+    std::vector<std::pair<size_t, size_t>> mirror;
+};
+
+// Plans rows [row_begin, row_end). When the fractal is conjugate symmetric and the real axis crosses the range, the
+// side of the axis with fewer rows is mirrored from the other one. A row is only mirrored when its imaginary
+// coordinate is exactly the negation of its partner's, so the image is bit-identical to computing every row; that
+// requires the axis to fall on a row or halfway between two, and rounding still rules out some pairs.
+template <typename Real>
+RowPlan plan_rows(const PixelMap<Real>& map, bool symmetric, size_t row_begin, size_t row_end) {
+    RowPlan plan;
+    long long axis2 = -1;
+    if(symmetric && map.bottom < Real(0) && map.top > Real(0))
+        axis2 = std::llround(-2.0 * double(map.bottom) * (map.height - 1) / (double(map.top) - double(map.bottom)));
+    if(axis2 < 0) {
+        for(size_t y = row_begin; y < row_end; ++y)
+            plan.compute.push_back(y);
+        return plan;
+    }
+
+    // -1 below the axis, 1 above, 0 on it. Compares doubled rows, since the axis may be halfway between two.
+    auto side = [&](size_t y) {
+        const long long row2 = 2 * (long long)(y + map.row_offset);
+        return (row2 > axis2) - (row2 < axis2);
+    };
+    size_t below = 0, above = 0;
+    for(size_t y = row_begin; y < row_end; ++y) {
+        below += side(y) < 0;
+        above += side(y) > 0;
+    }
+    const int mirrored_side = above <= below ? 1 : -1;
+    for(size_t y = row_begin; y < row_end; ++y) {
+        const long long partner = axis2 - (long long)(y + map.row_offset) - (long long)map.row_offset;
+        if(side(y) == mirrored_side && partner >= (long long)row_begin && partner < (long long)row_end
+            && map.imag(y) == -map.imag(size_t(partner)))
+            plan.mirror.push_back({y, size_t(partner)});
+        else
+            plan.compute.push_back(y);
+    }
+    return plan;
+}
+
+// Copies every mirrored row of `plane` from its partner
+template <typename T>
+void mirror_rows(const RowPlan& plan, size_t width, int n_threads, CostMap* cost, T* plane) {
+    #pragma omp parallel for num_threads(n_threads)
+    for(size_t i = 0; i < plan.mirror.size(); ++i) {
+        const auto [row, source] = plan.mirror[i];
+        std::copy_n(plane + source * width, width, plane + row * width);
+        if(cost)
+            cost->rows[row] = {0, 0.0, omp_get_thread_num()};
+    }
+}
+
+// Counts the iterations of one row, and times it into RenderOptions::cost when a cost map was requested.
+class RowCostScope {
+public:
+    RowCostScope(CostMap* cost, size_t y) : cost(cost), y(y) {
+        if(cost)
+            start = std::chrono::steady_clock::now();
+    }
+    ~RowCostScope() {
+        if(!cost)
+            return;
+        RowCost& row = cost->rows[y];
+        row.iterations = iterations;
+        row.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        row.worker = omp_get_thread_num();
+    }
+
+    uint64_t iterations = 0;
+
+private:
+    CostMap* cost;
+    size_t y;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Escape time of every pixel of row y, one pixel after the other. Returns the iterations executed.
+template <typename Real, typename Fractal>
+uint64_t escape_row(const Fractal& fractal, const PixelMap<Real>& map, size_t y, int max_iteration, int32_t* out) {
+    uint64_t total = 0;
+    for(size_t x = 0; x < map.width; ++x) {
+        Real real = map.real(x);
+        Real imag = map.imag(y);
+
+        Real zx, zy, cx, cy;
+        fractal.start(real, imag, zx, zy, cx, cy);
+        int iteration = 0;
+        while(zx * zx + zy * zy < Real(4) && iteration < max_iteration) {
+            fractal.step(zx, zy, cx, cy);
+            ++iteration;
+        }
+
+        total += iteration;
+        out[x] = iteration;
+    }
+    return total;
+}
+
+// Same result as escape_row(), but iterates K pixels of the row round-robin. Each pixel's iterations depend on the
+// previous one, so a single pixel leaves the FP units waiting on latency; K independent pixels keep them busy. A
+// slot whose pixel escapes is refilled with the next pixel of the row right away.
+template <int K, typename Real, typename Fractal>
+uint64_t escape_row_interleaved(const Fractal& fractal, const PixelMap<Real>& map, size_t y, int max_iteration,
+    int32_t* out) {
+    Real zx[K], zy[K], cx[K], cy[K];
+    int iteration[K];
+    size_t pixel[K];
+    bool active[K];
+    const Real imag = map.imag(y);
+    size_t next = 0;
+    int live = 0;
+    auto refill = [&](int k) {
+        active[k] = next < map.width;
+        if(!active[k])
+            return;
+        pixel[k] = next++;
+        fractal.start(map.real(pixel[k]), imag, zx[k], zy[k], cx[k], cy[k]);
+        iteration[k] = 0;
+        ++live;
+    };
+    for(int k = 0; k < K; ++k)
+        refill(k);
+
+    uint64_t total = 0;
+    while(live > 0) {
+        for(int k = 0; k < K; ++k) {
+            if(!active[k])
+                continue;
+            if(zx[k] * zx[k] + zy[k] * zy[k] < Real(4) && iteration[k] < max_iteration) {
+                fractal.step(zx[k], zy[k], cx[k], cy[k]);
+                ++iteration[k];
+                continue;
+            }
+            out[pixel[k]] = iteration[k];
+            total += iteration[k];
+            --live;
+            refill(k);
+        }
+    }
+    return total;
+}
+
+// Masked steps the vector kernel runs between compactions. Shorter intervals refill escaped lanes sooner but pay
+// the scalar compaction more often.
+constexpr int simd_compact_interval = 8;
+
+// Same result as escape_row(), iterating W lanes as one vector. Lanes step under a mask: a lane whose pixel escaped
+// keeps its z and iteration count while the others go on. Every simd_compact_interval steps, finished lanes write
+// their pixel by index, live lanes move to the front and the free lanes take the next pixels of the row, so the
+// vector only runs partly empty at the end of the row. `lane_slots` grows by W for every masked step.
+template <int W, typename Real, typename Fractal>
+uint64_t escape_row_simd(const Fractal& fractal, const PixelMap<Real>& map, size_t y, int max_iteration,
+    int32_t* out, uint64_t& lane_slots) {
+    alignas(64) Real zx[W], zy[W], cx[W], cy[W];
+    alignas(64) int iteration[W];
+    size_t pixel[W];
+    const Real imag = map.imag(y);
+    size_t next = 0;
+    int lanes = 0;
+    uint64_t total = 0;
+    while(true) {
+        int live = 0;
+        for(int k = 0; k < lanes; ++k) {
+            if(zx[k] * zx[k] + zy[k] * zy[k] < Real(4) && iteration[k] < max_iteration) {
+                zx[live] = zx[k];
+                zy[live] = zy[k];
+                cx[live] = cx[k];
+                cy[live] = cy[k];
+                iteration[live] = iteration[k];
+                pixel[live] = pixel[k];
+                ++live;
+            } else {
+                out[pixel[k]] = iteration[k];
+                total += iteration[k];
+            }
+        }
+        for(; live < W && next < map.width; ++live) {
+            pixel[live] = next++;
+            fractal.start(map.real(pixel[live]), imag, zx[live], zy[live], cx[live], cy[live]);
+            iteration[live] = 0;
+        }
+        if(live == 0)
+            return total;
+        // Unused lanes start outside the escape radius, so the mask keeps them idle
+        for(int k = live; k < W; ++k) {
+            zx[k] = zy[k] = Real(2);
+            cx[k] = cy[k] = Real(0);
+            iteration[k] = 0;
+        }
+        lanes = live;
+
+        for(int step = 0; step < simd_compact_interval; ++step) {
+            #pragma omp simd
+            for(int k = 0; k < W; ++k) {
+                const bool active = (zx[k] * zx[k] + zy[k] * zy[k] < Real(4)) & (iteration[k] < max_iteration);
+                Real nx = zx[k], ny = zy[k];
+                fractal.step(nx, ny, cx[k], cy[k]);
+                zx[k] = active ? nx : zx[k];
+                zy[k] = active ? ny : zy[k];
+                iteration[k] += active;
+            }
+        }
+        lane_slots += uint64_t(W) * simd_compact_interval;
+    }
+}
+
+// Both kernels render `rows` and return the number of iterations they executed, counted per thread and reduced at
+// the end.
+// escape_time() runs the loop `tuning` selects, and adds the lane slots of the vector kernel to `lane_slots`.
+template <typename Real, typename Fractal>
+uint64_t escape_time(const Fractal& fractal, const PixelMap<Real>& map, const RenderOptions& options,
+    const std::vector<size_t>& rows, int n_threads, const CpuTuning& tuning, int32_t* iterations,
+    uint64_t& lane_slots) {
+    const int max_iteration = options.max_iteration;
+    const CancelToken* cancel = options.cancel;
+    uint64_t total = 0;
+    uint64_t slots = 0;
+    #pragma omp parallel num_threads(n_threads) reduction(+:total, slots)
+    {
+        PerfScope counters(options.perf, "compute", omp_get_thread_num());
+        #pragma omp for schedule(runtime) nowait
+        for(size_t i = 0; i < rows.size(); ++i) {
+            const size_t y = rows[i];
+            if(cancel && cancel->load(std::memory_order_relaxed))
+                continue;
+            TRACE_ZONE_ID("row", y);
+            RowCostScope row_cost(options.cost, y);
+            int32_t* out = iterations + y * map.width;
+            if(tuning.simd_lanes == 16)
+                row_cost.iterations = escape_row_simd<16>(fractal, map, y, max_iteration, out, slots);
+            else if(tuning.simd_lanes == 8)
+                row_cost.iterations = escape_row_simd<8>(fractal, map, y, max_iteration, out, slots);
+            else if(tuning.interleave == 8)
+                row_cost.iterations = escape_row_interleaved<8>(fractal, map, y, max_iteration, out);
+            else if(tuning.interleave == 4)
+                row_cost.iterations = escape_row_interleaved<4>(fractal, map, y, max_iteration, out);
+            else
+                row_cost.iterations = escape_row(fractal, map, y, max_iteration, out);
+            total += row_cost.iterations;
+        }
+    }
+    lane_slots += slots;
+    return total;
+}
+
+template <typename Real, typename Fractal>
+uint64_t distance_estimate(const Fractal& fractal, const PixelMap<Real>& map, const RenderOptions& options,
+    const std::vector<size_t>& rows, int n_threads, float* distance) {
+    const int max_iteration = options.max_iteration;
+    const CancelToken* cancel = options.cancel;
+    uint64_t total = 0;
+    #pragma omp parallel num_threads(n_threads) reduction(+:total)
+    {
+        PerfScope counters(options.perf, "compute", omp_get_thread_num());
+        #pragma omp for schedule(runtime) nowait
+        for(size_t i = 0; i < rows.size(); ++i) {
+            const size_t y = rows[i];
+            if(cancel && cancel->load(std::memory_order_relaxed))
+                continue;
+            TRACE_ZONE_ID("row", y);
+            RowCostScope row_cost(options.cost, y);
+            for(size_t x = 0; x < map.width; ++x) {
+                Real real = map.real(x);
+                Real imag = map.imag(y);
+
+                Real zx, zy, cx, cy;
+                fractal.start(real, imag, zx, zy, cx, cy);
+                Real dzx = 1;
+                Real dzy = 0;
+                int iteration = 0;
+                while(zx * zx + zy * zy < Real(distance_bailout) && iteration < max_iteration) {
+                    fractal.step_derivative(zx, zy, dzx, dzy);
+                    fractal.step(zx, zy, cx, cy);
+                    ++iteration;
+                }
+
+                row_cost.iterations += iteration;
+                // Points that never escape are treated as inside the set (distance 0)
+                float d = 0.0f;
+                if(iteration < max_iteration) {
+                    Real r2 = zx * zx + zy * zy;
+                    Real dr2 = dzx * dzx + dzy * dzy;
+                    d = float(std::sqrt(r2 / dr2) * Real(0.5) * std::log(r2));
+                }
+                distance[y * map.width + x] = d;
+            }
+            total += row_cost.iterations;
+        }
+    }
+    return total;
+}
+
+}
@@ -0,0 +1,151 @@
+#include "diff.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#include "cpu_backend.hpp"
+#include "frontend.hpp"
+#include "report.hpp"
+#include "scenes.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+// Distance estimates are only compared up to their float rounding
+constexpr float distance_tolerance = 1e-3f;
+
+struct Agreement {
+    size_t pixels = 0;
+    size_t mismatched = 0;
+    // In iterations for escape time frames, in plane units for distance frames
+    double max_delta = 0.0;
+    double mean_delta = 0.0;
+    // Signed difference (backend - reference) of every pixel, 0 where they agree
+    std::vector<float> delta;
+};
+
+Agreement compare(const Frame& frame, const Frame& reference) {
+    Agreement agreement;
+    agreement.pixels = frame.width * frame.height;
+    agreement.delta.assign(agreement.pixels, 0.0f);
+    double sum = 0.0;
+    for(size_t i = 0; i < agreement.pixels; ++i) {
+        float delta;
+        if(frame.mode == RenderMode::Distance) {
+            const float a = frame.distance[i];
+            const float b = reference.distance[i];
+            delta = a - b;
+            if(std::abs(delta) <= distance_tolerance * std::max(std::abs(a), std::abs(b)))
+                continue;
+        }
+        else {
+            delta = float(frame.iterations[i] - reference.iterations[i]);
+            if(delta == 0.0f)
+                continue;
+        }
+        agreement.delta[i] = delta;
+        agreement.mismatched++;
+        agreement.max_delta = std::max(agreement.max_delta, double(std::abs(delta)));
+        sum += std::abs(delta);
+    }
+    agreement.mean_delta = agreement.pixels ? sum / agreement.pixels : 0.0;
+    return agreement;
+}
+
+// The reference dimmed to gray, with pixels where the backend is higher in red and lower in blue, brighter the
+// larger the difference
+std::vector<uint8_t> diff_image(const Agreement& agreement, const RgbBuffer& reference_rgb) {
+    std::vector<uint8_t> rgb(agreement.pixels * 3);
+    for(size_t i = 0; i < agreement.pixels; ++i) {
+        const uint8_t* in = reference_rgb.data() + i * 3;
+        uint8_t* out = rgb.data() + i * 3;
+        const float delta = agreement.delta[i];
+        if(delta == 0.0f) {
+            const uint8_t gray = uint8_t((0.299f * in[0] + 0.587f * in[1] + 0.114f * in[2]) / 2);
+            out[0] = out[1] = out[2] = gray;
+            continue;
+        }
+        const uint8_t intensity = uint8_t(128 + 127 * std::abs(delta) / agreement.max_delta);
+        out[0] = delta > 0 ? intensity : 0;
+        out[1] = 0;
+        out[2] = delta < 0 ? intensity : 0;
+    }
+    return rgb;
+}
+
+}
+
+int run_diff(Renderer& renderer, const DiffOptions& options) {
+    Renderer reference(std::make_unique<CpuBackend>());
+    const std::string name = renderer.backend().name();
+    for(const Workload& workload : bench_workloads(options.bench)) {
+        RenderOptions reference_options = workload.render;
+        if(options.reference_precision)
+            reference_options.precision = *options.reference_precision;
+
+        std::vector<double> seconds;
+        try {
+            seconds = time_renders(renderer, workload, options.bench.warmup, options.bench.repetitions);
+        } catch(const std::runtime_error& e) {
+            // On stderr so --report json output stays parseable
+            std::cerr << name << " " << workload.name() << ": skipped, " << e.what() << std::endl;
+            continue;
+        }
+        const std::vector<double> reference_seconds = time_renders(reference,
+            Workload{workload.scene, reference_options, workload.viewport},
+            options.bench.warmup, options.bench.repetitions);
+
+        const double median = summarize(seconds).median;
+        const double reference_median = summarize(reference_seconds).median;
+        const Agreement agreement = compare(renderer.frame(), reference.frame());
+
+        std::string image_file;
+        if(agreement.mismatched) {
+            image_file = options.output_prefix + "-" +
+                (workload.scene ? workload.scene->name : std::to_string(workload.render.width)) + ".png";
+            const std::vector<uint8_t> rgb = diff_image(agreement, reference.colorize());
+            if(!save_image(image_file, workload.render.width, workload.render.height, 3, rgb.data(),
+                    workload.render.width * 3)) {
+                std::cerr << "Failed to write " << image_file << std::endl;
+                return 1;
+            }
+        }
+
+        const double mismatched_percent = 100.0 * agreement.mismatched / agreement.pixels;
+        if(options.json) {
+            std::cout << "{\"scene\": " << (workload.scene ? json_string(workload.scene->name) : "null")
+                      << ", \"size\": " << workload.render.width
+                      << ", \"mode\": " << json_string(render_mode_name(workload.render.mode))
+                      << ", \"backend\": " << json_string(name)
+                      << ", \"precision\": " << json_string(precision_name(workload.render.precision))
+                      << ", \"reference\": \"cpu\""
+                      << ", \"reference_precision\": " << json_string(precision_name(reference_options.precision))
+                      << ", \"seconds\": " << median
+                      << ", \"reference_seconds\": " << reference_median
+                      << ", \"speedup\": " << reference_median / median
+                      << ", \"pixels\": " << agreement.pixels
+                      << ", \"mismatched\": " << agreement.mismatched
+                      << ", \"max_delta\": " << agreement.max_delta
+                      << ", \"mean_delta\": " << agreement.mean_delta
+                      << ", \"diff_image\": " << (image_file.empty() ? "null" : json_string(image_file)) << "}"
+                      << std::endl;
+            continue;
+        }
+        std::cout << workload.name() << ": " << name << " " << median << " s, cpu "
+                  << precision_name(reference_options.precision) << " " << reference_median << " s ("
+                  << reference_median / median << "x), " << agreement.mismatched << " of " << agreement.pixels << " pixels differ (" << mismatched_percent
+                  << "%), max |diff| " << agreement.max_delta << ", mean |diff| " << agreement.mean_delta;
+        if(!image_file.empty())
+            std::cout << ", see " << image_file;
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "bench.hpp"
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct DiffOptions {
+    // Scenes, sizes, repetitions and render settings, as for the benchmark. output_file and label are not used.
+    BenchOptions bench;
+    // Precision of the reference renders, the workload's own when unset
+    std::optional<Precision> reference_precision;
+    // Diff images of workloads with mismatches are written to <prefix>-<scene or size>.png
+    std::string output_prefix = "diff";
+    // Print one JSON document per workload instead of text
+    bool json = false;
+};
+
+// Renders every workload with the renderer's backend and with an in-process CPU reference, and reports the time of
+// both next to how many pixels differ and by how much. Returns the process exit code.
+int run_diff(Renderer& renderer, const DiffOptions& options);
+
+}
@@ -0,0 +1,388 @@
+#include "distributed.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "net.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+// Messages are raw structs: coordinator and workers are the same build on the same kind of host.
+constexpr uint32_t protocol_magic = 0x574d5454; // "TTMW"
+constexpr uint32_t protocol_version = 2;
+
+struct Hello {
+    uint32_t magic = protocol_magic;
+    uint32_t version = protocol_version;
+};
+
+struct WireConfig {
+    Viewport viewport;
+    uint64_t width;
+    uint64_t height;
+    int32_t max_iteration;
+    int32_t mode;
+    int32_t fractal;
+    int32_t power;
+    float julia_real;
+    float julia_imag;
+    int32_t precision;
+};
+
+struct Assignment {
+    uint64_t band;
+    uint64_t row_begin;
+    uint64_t row_end;
+};
+
+struct BandHeader {
+    uint64_t band;
+    uint64_t bytes;
+};
+
+// How long the coordinator waits with unfinished work and no worker connected before giving up
+constexpr auto worker_timeout = std::chrono::seconds(60);
+// Finished bands waiting for an earlier one are buffered; this bounds how far ahead of the writer bands are handed out
+constexpr size_t max_buffered_bytes = 256 << 20;
+
+class Coordinator {
+public:
+    Coordinator(const Viewport& viewport, const RenderOptions& options, const ClusterOptions& cluster)
+        : options(options), cluster(cluster) {
+        config = {viewport, options.width, options.height, options.max_iteration, int32_t(options.mode),
+            int32_t(options.fractal.type), options.fractal.power, options.fractal.julia_real,
+            options.fractal.julia_imag, int32_t(options.precision)};
+
+        const size_t band_rows = std::max<size_t>(cluster.band_rows, 1);
+        for(size_t y = 0; y < options.height; y += band_rows)
+            bands.push_back({y, std::min(y + band_rows, options.height)});
+        window = std::max<size_t>(4, max_buffered_bytes / (band_rows * options.width * 3));
+    }
+
+    int run(const std::string& output_file) {
+        if(!output_file.ends_with(".png")) {
+            std::cerr << "Distributed rendering writes PNG only, got " << output_file << std::endl;
+            return 1;
+        }
+        PngRowWriter writer;
+        if(!writer.open(output_file.c_str(), options.width, options.height)) {
+            std::cerr << "Failed to open " << output_file << std::endl;
+            return 1;
+        }
+        listener = open_listener(cluster.address);
+        if(listener < 0)
+            return 1;
+        std::cout << "Coordinating " << bands.size() << " bands on " << cluster.address << std::endl;
+
+        spawn_workers();
+        std::thread acceptor(&Coordinator::accept_loop, this);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        int status = 0;
+        for(size_t next = 0; next < bands.size() && status == 0; ++next) {
+            std::vector<uint8_t> rgb;
+            {
+                TRACE_ZONE_ID("wait_band", next);
+                std::unique_lock lock(mutex);
+                auto idle_since = std::chrono::steady_clock::now();
+                while(!bands[next].done) {
+                    cv.wait_for(lock, std::chrono::seconds(1));
+                    if(workers > 0)
+                        idle_since = std::chrono::steady_clock::now();
+                    else if(std::chrono::steady_clock::now() - idle_since > worker_timeout)
+                        break;
+                }
+                if(!bands[next].done) {
+                    std::cerr << "No workers connected for " << worker_timeout.count() << " seconds" << std::endl;
+                    status = 1;
+                    break;
+                }
+                rgb = std::move(bands[next].rgb);
+                next_write = next + 1;
+            }
+            cv.notify_all();
+            const Band& band = bands[next];
+            TRACE_ZONE_ID("write_band", next);
+            if(!writer.write_rows(rgb.data(), band.row_end - band.row_begin, options.width * 3)) {
+                std::cerr << "Failed to write " << output_file << std::endl;
+                status = 1;
+            }
+        }
+        if(status == 0 && !writer.finish()) {
+            std::cerr << "Failed to write " << output_file << std::endl;
+            status = 1;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        shutdown_all();
+        acceptor.join();
+        for(std::thread& t : connections)
+            t.join();
+        for(int fd : sockets)
+            close(fd);
+        close(listener);
+        for(pid_t pid : children)
+            waitpid(pid, nullptr, 0);
+
+        if(status == 0) {
+            std::chrono::duration<double> elapsed = end - start;
+            std::cout << "Elapsed time: " << elapsed.count() << " seconds" << std::endl;
+            std::cout << "Bands: " << bands.size() << ", workers: " << workers_seen << ", reassigned: " << reassigned
+                      << ", duplicated: " << duplicated << std::endl;
+        }
+        return status;
+    }
+
+private:
+    struct Band {
+        size_t row_begin;
+        size_t row_end;
+        // Workers currently holding the band, more than one when it was duplicated
+        int assigned = 0;
+        bool done = false;
+        std::vector<uint8_t> rgb{};
+    };
+
+    void spawn_workers() {
+        for(int i = 0; i < cluster.spawn_workers; ++i) {
+            std::vector<std::string> args = {"/proc/self/exe", "--worker", cluster.address};
+            args.insert(args.end(), cluster.worker_args.begin(), cluster.worker_args.end());
+            pid_t pid = fork();
+            if(pid == 0) {
+                close(listener);
+                std::vector<char*> argv;
+                for(std::string& arg : args)
+                    argv.push_back(arg.data());
+                argv.push_back(nullptr);
+                execv(argv[0], argv.data());
+                _exit(127);
+            }
+            if(pid > 0)
+                children.push_back(pid);
+            else
+                std::cerr << "Failed to spawn worker" << std::endl;
+        }
+    }
+
+    void accept_loop() {
+        for(;;) {
+            int fd = accept(listener, nullptr, nullptr);
+            std::lock_guard lock(mutex);
+            if(finished) {
+                if(fd >= 0)
+                    close(fd);
+                return;
+            }
+            if(fd < 0) {
+                if(errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            sockets.push_back(fd);
+            connections.emplace_back(&Coordinator::serve_worker, this, fd);
+        }
+    }
+
+    // Next band for a connection, or nothing once every band is done. Blocks only when `block` is set.
+    std::optional<size_t> acquire(const std::deque<size_t>& in_flight, bool block) {
+        std::unique_lock lock(mutex);
+        for(;;) {
+            if(finished || done_count == bands.size())
+                return std::nullopt;
+            const size_t end = std::min(bands.size(), next_write + window);
+            for(size_t i = next_write; i < end; ++i) {
+                if(!bands[i].done && bands[i].assigned == 0) {
+                    bands[i].assigned++;
+                    return i;
+                }
+            }
+            // Nothing new to hand out: an idle worker races whoever holds the oldest unfinished band
+            if(in_flight.empty()) {
+                for(size_t i = next_write; i < end; ++i) {
+                    if(!bands[i].done && bands[i].assigned == 1) {
+                        bands[i].assigned++;
+                        duplicated++;
+                        return i;
+                    }
+                }
+            }
+            if(!block)
+                return std::nullopt;
+            cv.wait(lock);
+        }
+    }
+
+    void complete(size_t band, std::vector<uint8_t>&& rgb) {
+        {
+            std::lock_guard lock(mutex);
+            bands[band].assigned--;
+            if(!bands[band].done) {
+                bands[band].done = true;
+                bands[band].rgb = std::move(rgb);
+                done_count++;
+            }
+        }
+        cv.notify_all();
+    }
+
+    void serve_worker(int fd) {
+        Hello hello;
+        if(!recv_all(fd, &hello, sizeof(hello)) || hello.magic != protocol_magic
+            || hello.version != protocol_version || !send_all(fd, &config, sizeof(config))) {
+            std::cerr << "Rejected a worker with a different protocol" << std::endl;
+            return;
+        }
+        {
+            std::lock_guard lock(mutex);
+            workers++;
+            workers_seen++;
+        }
+        cv.notify_all();
+
+        std::deque<size_t> in_flight;
+        for(;;) {
+            bool sent = true;
+            while(in_flight.size() < 2) {
+                std::optional<size_t> band = acquire(in_flight, in_flight.empty());
+                if(!band)
+                    break;
+                in_flight.push_back(*band);
+                Assignment assignment{*band, bands[*band].row_begin, bands[*band].row_end};
+                if(!send_all(fd, &assignment, sizeof(assignment))) {
+                    sent = false;
+                    break;
+                }
+            }
+            if(!sent || in_flight.empty())
+                break;
+
+            const size_t band = in_flight.front();
+            TRACE_ZONE_ID("receive_band", band);
+            const size_t expected = (bands[band].row_end - bands[band].row_begin) * options.width * 3;
+            BandHeader header;
+            std::vector<uint8_t> rgb(expected);
+            if(!recv_all(fd, &header, sizeof(header)) || header.band != band || header.bytes != expected
+                || !recv_all(fd, rgb.data(), rgb.size()))
+                break;
+            in_flight.pop_front();
+            complete(band, std::move(rgb));
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            workers--;
+            for(size_t band : in_flight) {
+                if(--bands[band].assigned == 0 && !bands[band].done)
+                    reassigned++;
+            }
+        }
+        cv.notify_all();
+    }
+
+    // Wakes every thread blocked on a socket so they can be joined. Workers see the coordinator hang up and exit.
+    void shutdown_all() {
+        {
+            std::lock_guard lock(mutex);
+            finished = true;
+            for(int fd : sockets)
+                shutdown(fd, SHUT_RDWR);
+            shutdown(listener, SHUT_RDWR);
+        }
+        cv.notify_all();
+    }
+
+    const RenderOptions options;
+    const ClusterOptions cluster;
+    WireConfig config;
+    std::vector<Band> bands;
+    size_t window;
+    int listener = -1;
+    std::vector<pid_t> children;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<int> sockets;
+    std::vector<std::thread> connections;
+    size_t next_write = 0;
+    size_t done_count = 0;
+    bool finished = false;
+    int workers = 0;
+    int workers_seen = 0;
+    size_t reassigned = 0;
+    size_t duplicated = 0;
+};
+
+}
+
+int run_coordinator(const Viewport& viewport, const RenderOptions& options, const std::string& output_file,
+    const ClusterOptions& cluster) {
+    Coordinator coordinator(viewport, options, cluster);
+    return coordinator.run(output_file);
+}
+
+int run_worker(Renderer& renderer, const std::string& address) {
+    int fd = connect_to(address);
+    if(fd < 0)
+        return 1;
+    Hello hello;
+    WireConfig config;
+    if(!send_all(fd, &hello, sizeof(hello)) || !recv_all(fd, &config, sizeof(config))) {
+        std::cerr << "Coordinator at " << address << " did not answer" << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    RenderOptions options;
+    options.width = config.width;
+    options.image_height = config.height;
+    options.max_iteration = config.max_iteration;
+    options.mode = RenderMode(config.mode);
+    options.fractal = {FractalType(config.fractal), config.julia_real, config.julia_imag, config.power};
+    options.precision = Precision(config.precision);
+
+    size_t rendered = 0;
+    double compute_seconds = 0.0;
+    Assignment assignment;
+    // The coordinator hangs up once every band is done
+    while(recv_all(fd, &assignment, sizeof(assignment))) {
+        options.row_offset = assignment.row_begin;
+        options.height = assignment.row_end - assignment.row_begin;
+        TRACE_ZONE_ID("band", assignment.band);
+        try {
+            const RgbBuffer& rgb = renderer.render_rgb(config.viewport, options);
+            compute_seconds += renderer.frame().compute_seconds;
+            BandHeader header{assignment.band, rgb.size()};
+            if(!send_all(fd, &header, sizeof(header)) || !send_all(fd, rgb.data(), rgb.size()))
+                break;
+        } catch(const std::exception& e) {
+            std::cerr << "Failed to render band " << assignment.band << ": " << e.what() << std::endl;
+            close(fd);
+            return 1;
+        }
+        rendered++;
+    }
+    close(fd);
+    std::cout << "Worker rendered " << rendered << " bands, compute time: " << compute_seconds << " seconds" << std::endl;
+    return 0;
+}
+
+}
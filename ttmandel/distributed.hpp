@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct ClusterOptions {
+    // Address the coordinator listens on and workers connect to, "host:port" or "unix:/path/to/socket"
+    std::string address;
+    size_t band_rows = 64;
+    // Workers the coordinator starts itself by running this executable with --worker, for single host runs
+    int spawn_workers = 0;
+    // Extra arguments for spawned workers, e.g. their thread count
+    std::vector<std::string> worker_args;
+};
+
+// Renders one image on worker processes and streams it into `output_file`, which must be a PNG, without ever
+// holding the whole image. Workers render bands through RenderOptions::row_offset, so the result matches a single
+// process render exactly. Bands are handed out on demand, two at a time so workers never wait for a round trip.
+// Bands of a worker that disconnects go back to the pool, and once nothing new is left an idle worker duplicates
+// the oldest unfinished band so one slow worker cannot hold up the output. Returns the process exit code.
+int run_coordinator(const Viewport& viewport, const RenderOptions& options, const std::string& output_file,
+    const ClusterOptions& cluster);
+
+// Connects to a coordinator and renders the bands it assigns until it hangs up. Returns the process exit code.
+int run_worker(Renderer& renderer, const std::string& address);
+
+}
@@ -0,0 +1,232 @@
+#include "energy.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+#include "report.hpp"
+
+#ifndef TTMANDEL_POWERCAP_ROOT
+#define TTMANDEL_POWERCAP_ROOT "/sys/class/powercap"
+#endif
+
+namespace ttmandel {
+
+namespace {
+
+constexpr const char* domain_names[energy_domain_count] = {"package", "dram"};
+constexpr uint64_t unreadable = std::numeric_limits<uint64_t>::max();
+
+struct Zone {
+    EnergyDomain domain;
+    std::string energy_file;
+    // energy_uj wraps around to 0 after this
+    uint64_t max_range_uj;
+};
+
+struct Zones {
+    std::vector<Zone> zones;
+    std::string unavailable_reason;
+};
+
+uint64_t read_uj(const std::string& path) {
+    std::ifstream in(path);
+    uint64_t value;
+    return in >> value ? value : unreadable;
+}
+
+// Package zones are intel-rapl:<socket>, their DRAM subzones intel-rapl:<socket>:<n>. AMD's driver registers the
+// same names. The intel-rapl-mmio zones duplicate the package ones and psys covers the whole platform, so both are
+// left out to avoid double counting.
+Zones discover() {
+    Zones found;
+    std::error_code error;
+    std::filesystem::directory_iterator it(TTMANDEL_POWERCAP_ROOT, error);
+    if(error) {
+        found.unavailable_reason = std::string(TTMANDEL_POWERCAP_ROOT) + ": " + error.message();
+        return found;
+    }
+    for(const std::filesystem::directory_entry& entry : it) {
+        const std::string zone = entry.path().filename();
+        if(!zone.starts_with("intel-rapl:"))
+            continue;
+        std::string name;
+        std::ifstream(entry.path() / "name") >> name;
+        EnergyDomain domain;
+        if(name.starts_with("package"))
+            domain = EnergyDomain::Package;
+        else if(name == "dram")
+            domain = EnergyDomain::Dram;
+        else
+            continue;
+
+        const std::string energy_file = entry.path() / "energy_uj";
+        // energy_uj has been readable by root only since Linux 5.10, the RAPL power side channel fix
+        FILE* probe = std::fopen(energy_file.c_str(), "r");
+        if(!probe) {
+            if(found.unavailable_reason.empty())
+                found.unavailable_reason = energy_file + ": " + std::strerror(errno);
+            continue;
+        }
+        std::fclose(probe);
+        uint64_t max_range = read_uj(entry.path() / "max_energy_range_uj");
+        found.zones.push_back({domain, energy_file, max_range == unreadable ? 0 : max_range});
+    }
+    if(found.zones.empty() && found.unavailable_reason.empty())
+        found.unavailable_reason = std::string("no package or dram RAPL zone in ") + TTMANDEL_POWERCAP_ROOT;
+    if(!found.zones.empty())
+        found.unavailable_reason.clear();
+    return found;
+}
+
+const Zones& zones() {
+    static const Zones found = discover();
+    return found;
+}
+
+std::vector<uint64_t> read_all() {
+    std::vector<uint64_t> values;
+    for(const Zone& zone : zones().zones)
+        values.push_back(read_uj(zone.energy_file));
+    return values;
+}
+
+EnergyValues difference(const std::vector<uint64_t>& end, const std::vector<uint64_t>& start) {
+    EnergyValues d;
+    const std::vector<Zone>& all = zones().zones;
+    for(size_t i = 0; i < all.size(); ++i) {
+        if(start[i] == unreadable || end[i] == unreadable || (end[i] < start[i] && all[i].max_range_uj == 0))
+            continue;
+        const uint64_t delta = end[i] >= start[i] ? end[i] - start[i] : end[i] + all[i].max_range_uj - start[i];
+        d.joules[size_t(all[i].domain)] += delta / 1e6;
+        d.available[size_t(all[i].domain)] = true;
+    }
+    return d;
+}
+
+void write_values_json(std::ostream& out, const EnergyValues& values) {
+    out << "{";
+    for(size_t i = 0; i < energy_domain_count; ++i) {
+        out << (i ? ", " : "") << "\"" << domain_names[i] << "\": ";
+        if(values.available[i])
+            out << values.joules[i];
+        else
+            out << "null";
+    }
+    out << "}";
+}
+
+}
+
+double EnergyValues::total() const {
+    double sum = 0.0;
+    for(size_t i = 0; i < energy_domain_count; ++i) {
+        if(available[i])
+            sum += joules[i];
+    }
+    return sum;
+}
+
+EnergyValues& EnergyValues::operator+=(const EnergyValues& other) {
+    for(size_t i = 0; i < energy_domain_count; ++i) {
+        joules[i] += other.joules[i];
+        available[i] = available[i] || other.available[i];
+    }
+    return *this;
+}
+
+void EnergyProfile::add(const std::string& phase, const EnergyValues& values) {
+    auto it = std::find_if(phases_.begin(), phases_.end(), [&](const Phase& p) { return p.name == phase; });
+    if(it == phases_.end())
+        phases_.push_back({phase, values});
+    else
+        it->energy += values;
+}
+
+std::optional<EnergyValues> EnergyProfile::total() const {
+    EnergyValues sum;
+    for(const Phase& phase : phases_)
+        sum += phase.energy;
+    if(std::find(sum.available.begin(), sum.available.end(), true) == sum.available.end())
+        return std::nullopt;
+    return sum;
+}
+
+void EnergyProfile::print(std::ostream& out, uint64_t pixels) const {
+    const std::optional<EnergyValues> sum = total();
+    if(!sum) {
+        const std::string reason = energy_unavailable_reason();
+        out << "Energy counters unavailable" << (reason.empty() ? "" : ": " + reason) << "\n";
+        return;
+    }
+
+    auto print_row = [&](const std::string& label, const EnergyValues& v) {
+        out << std::left << std::setw(14) << label << std::right << std::fixed << std::setprecision(4);
+        for(size_t i = 0; i < energy_domain_count; ++i) {
+            if(v.available[i])
+                out << std::setw(12) << v.joules[i];
+            else
+                out << std::setw(12) << "n/a";
+        }
+        out << std::setw(12) << v.total() << std::defaultfloat << "\n";
+    };
+
+    out << std::left << std::setw(14) << "phase" << std::right;
+    for(const char* name : domain_names)
+        out << std::setw(12) << std::string(name) + " J";
+    out << std::setw(12) << "total J" << "\n";
+    for(const Phase& phase : phases_)
+        print_row(phase.name, phase.energy);
+    print_row("frame", *sum);
+    if(sum->total() > 0.0)
+        out << "Energy efficiency: " << std::fixed << std::setprecision(3) << pixels / sum->total() / 1e6
+            << " Mpixel/J" << std::defaultfloat << "\n";
+}
+
+void EnergyProfile::write_json(std::ostream& out, uint64_t pixels) const {
+    const std::optional<EnergyValues> sum = total();
+    const std::string reason = energy_unavailable_reason();
+    out << "{\"unavailable\": ";
+    if(reason.empty())
+        out << "null";
+    else
+        out << json_string(reason);
+    out << ", \"phases\": {";
+    for(size_t p = 0; sum && p < phases_.size(); ++p) {
+        out << (p ? ", " : "") << json_string(phases_[p].name) << ": ";
+        write_values_json(out, phases_[p].energy);
+    }
+    out << "}, \"joules_per_frame\": ";
+    if(sum)
+        out << sum->total();
+    else
+        out << "null";
+    out << ", \"pixels_per_joule\": ";
+    if(sum && sum->total() > 0.0)
+        out << pixels / sum->total();
+    else
+        out << "null";
+    out << "}";
+}
+
+EnergyScope::EnergyScope(EnergyProfile* profile, const char* phase)
+    : profile(profile), phase(phase) {
+    if(profile)
+        start = read_all();
+}
+
+EnergyScope::~EnergyScope() {
+    if(profile && !zones().zones.empty())
+        profile->add(phase, difference(read_all(), start));
+}
+
+std::string energy_unavailable_reason() {
+    return zones().unavailable_reason;
+}
+
+}
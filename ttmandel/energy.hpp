@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ttmandel {
+
+enum class EnergyDomain {
+    Package,
+    Dram,
+};
+constexpr size_t energy_domain_count = 2;
+
+struct EnergyValues {
+    std::array<double, energy_domain_count> joules{};
+    // Domains the machine has no readable RAPL zone for stay unavailable
+    std::array<bool, energy_domain_count> available{};
+
+    double operator[](EnergyDomain domain) const { return joules[size_t(domain)]; }
+    bool has(EnergyDomain domain) const { return available[size_t(domain)]; }
+    // Sum of the available domains
+    double total() const;
+    EnergyValues& operator+=(const EnergyValues& other);
+};
+
+// Package and DRAM energy per phase, read from the RAPL zones of /sys/class/powercap when RenderOptions::energy
+// points at one. The counters cover the whole socket, so other load on the machine is counted too, and they
+// update about once per millisecond, which makes phases much shorter than that read as 0.
+class EnergyProfile {
+public:
+    struct Phase {
+        std::string name;
+        EnergyValues energy;
+    };
+
+    void add(const std::string& phase, const EnergyValues& values);
+
+    // Phases in the order they were first recorded
+    const std::vector<Phase>& phases() const { return phases_; }
+    // Sum over the phases, nullopt when no domain was readable
+    std::optional<EnergyValues> total() const;
+
+    // Joules per phase and domain, then joules per frame and pixels per joule. Explains why nothing was recorded
+    // when RAPL is unavailable.
+    void print(std::ostream& out, uint64_t pixels) const;
+    void write_json(std::ostream& out, uint64_t pixels) const;
+
+private:
+    std::vector<Phase> phases_;
+};
+
+// Adds the energy used from construction to destruction to `phase` of `profile`. Does nothing when `profile` is
+// null or RAPL is unavailable.
+class EnergyScope {
+public:
+    EnergyScope(EnergyProfile* profile, const char* phase);
+    ~EnergyScope();
+
+    EnergyScope(const EnergyScope&) = delete;
+    EnergyScope& operator=(const EnergyScope&) = delete;
+
+private:
+    EnergyProfile* profile;
+    const char* phase;
+    // Raw counter of every RAPL zone, in microjoules
+    std::vector<uint64_t> start;
+};
+
+// Why no RAPL zone could be read, empty if at least one can
+std::string energy_unavailable_reason();
+
+}
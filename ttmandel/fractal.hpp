@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace ttmandel {
+
+enum class FractalType {
+    Mandelbrot,
+    Julia,
+    Multibrot,
+    BurningShip,
+    Tricorn,
+};
+
+struct FractalConfig {
+    FractalType type = FractalType::Mandelbrot;
+    float julia_real = -0.8f;
+    float julia_imag = 0.156f;
+    int power = 3;
+};
+
+// Iteration policies. Each one describes how a pixel seeds z and c, and how z advances. The kernels are templated
+// on the policy so every fractal gets its own fully inlined inner loop. Policies that are holomorphic also provide
+// the derivative step used by the distance estimator, which must be called with z from *before* step().
+// conjugate_symmetric() tells whether conjugating the pixel conjugates every z, which makes the image symmetric about
+// the real axis.
+struct Mandelbrot {
+    static constexpr bool has_derivative = true;
+    bool conjugate_symmetric() const { return true; }
+
+    template <typename T>
+    void start(T px, T py, T& zx, T& zy, T& cx, T& cy) const {
+        zx = cx = px;
+        zy = cy = py;
+    }
+
+    template <typename T>
+    void step(T& zx, T& zy, T cx, T cy) const {
+        T tmp = zx * zx - zy * zy + cx;
+        zy = T(2) * zx * zy + cy;
+        zx = tmp;
+    }
+
+    // z starts at c, so dz/dc starts at 1 and follows dz' = 2·z·dz + 1
+    template <typename T>
+    void step_derivative(T zx, T zy, T& dzx, T& dzy) const {
+        T tmp = T(2) * (zx * dzx - zy * dzy) + T(1);
+        dzy = T(2) * (zx * dzy + zy * dzx);
+        dzx = tmp;
+    }
+};
+
+struct Julia {
+    static constexpr bool has_derivative = true;
+    float c_real;
+    float c_imag;
+
+    // Only real constants commute with conjugation
+    bool conjugate_symmetric() const { return c_imag == 0.0f; }
+
+    template <typename T>
+    void start(T px, T py, T& zx, T& zy, T& cx, T& cy) const {
+        zx = px;
+        zy = py;
+        cx = c_real;
+        cy = c_imag;
+    }
+
+    template <typename T>
+    void step(T& zx, T& zy, T cx, T cy) const {
+        T tmp = zx * zx - zy * zy + cx;
+        zy = T(2) * zx * zy + cy;
+        zx = tmp;
+    }
+
+    // c is fixed, so the derivative is taken w.r.t. the starting point: dz' = 2·z·dz
+    template <typename T>
+    void step_derivative(T zx, T zy, T& dzx, T& dzy) const {
+        T tmp = T(2) * (zx * dzx - zy * dzy);
+        dzy = T(2) * (zx * dzy + zy * dzx);
+        dzx = tmp;
+    }
+};
+
+template <int Power>
+struct Multibrot {
+    static_assert(Power >= 2);
+    static constexpr bool has_derivative = true;
+    bool conjugate_symmetric() const { return true; }
+
+    template <typename T>
+    static void pow(T zx, T zy, T& rx, T& ry, int n) {
+        rx = zx;
+        ry = zy;
+        for(int i = 1; i < n; ++i) {
+            T tmp = rx * zx - ry * zy;
+            ry = rx * zy + ry * zx;
+            rx = tmp;
+        }
+    }
+
+    template <typename T>
+    void start(T px, T py, T& zx, T& zy, T& cx, T& cy) const {
+        zx = cx = px;
+        zy = cy = py;
+    }
+
+    template <typename T>
+    void step(T& zx, T& zy, T cx, T cy) const {
+        T rx, ry;
+        pow(zx, zy, rx, ry, Power);
+        zx = rx + cx;
+        zy = ry + cy;
+    }
+
+    // dz' = d·z^(d-1)·dz + 1
+    template <typename T>
+    void step_derivative(T zx, T zy, T& dzx, T& dzy) const {
+        T rx, ry;
+        pow(zx, zy, rx, ry, Power - 1);
+        T tmp = T(Power) * (rx * dzx - ry * dzy) + T(1);
+        dzy = T(Power) * (rx * dzy + ry * dzx);
+        dzx = tmp;
+    }
+};
+
+struct BurningShip {
+    static constexpr bool has_derivative = false;
+    // The absolute value folds the lower half plane onto the upper one
+    bool conjugate_symmetric() const { return false; }
+
+    template <typename T>
+    void start(T px, T py, T& zx, T& zy, T& cx, T& cy) const {
+        zx = cx = px;
+        zy = cy = py;
+    }
+
+    template <typename T>
+    void step(T& zx, T& zy, T cx, T cy) const {
+        T tmp = zx * zx - zy * zy + cx;
+        zy = T(2) * std::abs(zx * zy) + cy;
+        zx = tmp;
+    }
+};
+
+struct Tricorn {
+    static constexpr bool has_derivative = false;
+    bool conjugate_symmetric() const { return true; }
+
+    template <typename T>
+    void start(T px, T py, T& zx, T& zy, T& cx, T& cy) const {
+        zx = cx = px;
+        zy = cy = py;
+    }
+
+    template <typename T>
+    void step(T& zx, T& zy, T cx, T cy) const {
+        T tmp = zx * zx - zy * zy + cx;
+        zy = T(-2) * zx * zy + cy;
+        zx = tmp;
+    }
+};
+
+// Calls func with the policy object matching the runtime configuration. This is the only place the fractal type
+// is looked at; everything below func is specialized at compile time.
+template <typename Func>
+void with_fractal(const FractalConfig& config, Func&& func) {
+    switch(config.type) {
+        case FractalType::Mandelbrot: return func(Mandelbrot{});
+        case FractalType::Julia: return func(Julia{config.julia_real, config.julia_imag});
+        case FractalType::BurningShip: return func(BurningShip{});
+        case FractalType::Tricorn: return func(Tricorn{});
+        case FractalType::Multibrot:
+            switch(config.power) {
+                case 2: return func(Multibrot<2>{});
+                case 3: return func(Multibrot<3>{});
+                case 4: return func(Multibrot<4>{});
+                case 5: return func(Multibrot<5>{});
+                case 6: return func(Multibrot<6>{});
+                case 7: return func(Multibrot<7>{});
+                case 8: return func(Multibrot<8>{});
+            }
+            throw std::runtime_error("Unsupported multibrot power " + std::to_string(config.power));
+    }
+}
+
+}
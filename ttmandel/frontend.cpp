@@ -0,0 +1,478 @@
+#include "frontend.hpp"
+
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "cost_map.hpp"
+#include "diff.hpp"
+#include "energy.hpp"
+#include "jobs.hpp"
+#include "memory_profile.hpp"
+#include "perf_counters.hpp"
+#include "report.hpp"
+#include "scenes.hpp"
+#include "trace.hpp"
+#include "tile_server.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+std::string next_arg(int& i, int argc, char** argv) {
+    if (i + 1 >= argc) {
+        std::cerr << "Expected argument after " << argv[i] << std::endl;
+        exit(1);
+    }
+    return argv[++i];
+}
+
+std::optional<RenderMode> parse_render_mode(std::string_view name) {
+    if (name == "escape") {
+        return RenderMode::EscapeTime;
+    } else if (name == "distance") {
+        return RenderMode::Distance;
+    }
+    return std::nullopt;
+}
+
+std::optional<FractalType> parse_fractal_type(std::string_view name) {
+    if (name == "mandelbrot") {
+        return FractalType::Mandelbrot;
+    } else if (name == "julia") {
+        return FractalType::Julia;
+    } else if (name == "multibrot") {
+        return FractalType::Multibrot;
+    } else if (name == "burning-ship") {
+        return FractalType::BurningShip;
+    } else if (name == "tricorn") {
+        return FractalType::Tricorn;
+    }
+    return std::nullopt;
+}
+
+std::optional<Precision> parse_precision(std::string_view name) {
+    if (name == "single") {
+        return Precision::Single;
+    } else if (name == "double") {
+        return Precision::Double;
+    }
+    return std::nullopt;
+}
+
+std::optional<PyramidLayout> parse_pyramid_layout(std::string_view name) {
+    if (name == "dzi") {
+        return PyramidLayout::Dzi;
+    } else if (name == "xyz") {
+        return PyramidLayout::Xyz;
+    }
+    return std::nullopt;
+}
+
+std::string render_mode_name(RenderMode mode) {
+    switch (mode) {
+    case RenderMode::EscapeTime: return "escape";
+    case RenderMode::Distance: return "distance";
+    }
+    return "unknown";
+}
+
+std::string fractal_type_name(FractalType type) {
+    switch (type) {
+    case FractalType::Mandelbrot: return "mandelbrot";
+    case FractalType::Julia: return "julia";
+    case FractalType::Multibrot: return "multibrot";
+    case FractalType::BurningShip: return "burning-ship";
+    case FractalType::Tricorn: return "tricorn";
+    }
+    return "unknown";
+}
+
+std::string precision_name(Precision precision) {
+    switch (precision) {
+    case Precision::Single: return "single";
+    case Precision::Double: return "double";
+    }
+    return "unknown";
+}
+
+// Parses a comma separated list of exactly `n` numbers, e.g. "-2,1,-1.5,1.5"
+static std::vector<double> parse_numbers(const std::string& list, size_t n, std::string_view option) {
+    std::vector<double> values;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        values.push_back(std::stod(list.substr(pos, comma - pos)));
+        pos = comma + 1;
+    }
+    if (values.size() != n) {
+        std::cerr << "Expected " << n << " comma separated values after " << option << std::endl;
+        exit(1);
+    }
+    return values;
+}
+
+// Catalog scenes or sizes of --bench and --diff
+static void parse_workloads(const std::string& list, BenchOptions& bench) {
+    try {
+        if (std::isdigit(static_cast<unsigned char>(list[0]))) {
+            bench.sizes = parse_sizes(list);
+        } else {
+            bench.scenes = parse_scenes(list);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+}
+
+bool parse_common_arg(std::string_view arg, int& i, int argc, char** argv, FrontendOptions& options) {
+    RenderOptions& render = options.render;
+    if (arg == "--width" || arg == "-w") {
+        render.width = std::stoi(next_arg(i, argc, argv));
+    } else if (arg == "--height" || arg == "-h") {
+        render.height = std::stoi(next_arg(i, argc, argv));
+    } else if (arg == "--output" || arg == "-o") {
+        options.output_file = next_arg(i, argc, argv);
+    } else if (arg == "--max-iter" || arg == "-i") {
+        render.max_iteration = std::stoi(next_arg(i, argc, argv));
+    } else if (arg == "--viewport") {
+        std::vector<double> v = parse_numbers(next_arg(i, argc, argv), 4, arg);
+        options.viewport = Viewport{v[0], v[1], v[2], v[3]};
+    } else if (arg == "--mode" || arg == "-m") {
+        std::string m = next_arg(i, argc, argv);
+        std::optional<RenderMode> mode = parse_render_mode(m);
+        if (!mode) {
+            std::cerr << "Unknown mode: " << m << std::endl;
+            exit(1);
+        }
+        render.mode = *mode;
+    } else if (arg == "--fractal" || arg == "-f") {
+        std::string f = next_arg(i, argc, argv);
+        std::optional<FractalType> type = parse_fractal_type(f);
+        if (!type) {
+            std::cerr << "Unknown fractal: " << f << std::endl;
+            exit(1);
+        }
+        render.fractal.type = *type;
+    } else if (arg == "--julia") {
+        std::vector<double> c = parse_numbers(next_arg(i, argc, argv), 2, arg);
+        render.fractal.julia_real = c[0];
+        render.fractal.julia_imag = c[1];
+    } else if (arg == "--power" || arg == "-p") {
+        render.fractal.power = std::stoi(next_arg(i, argc, argv));
+        if (render.fractal.power < 2 || render.fractal.power > 8) {
+            std::cerr << "Multibrot power must be between 2 and 8" << std::endl;
+            exit(1);
+        }
+    } else if (arg == "--scene") {
+        std::string name = next_arg(i, argc, argv);
+        const Scene* scene = find_scene(name);
+        if (!scene) {
+            std::cerr << "Unknown scene: " << name << std::endl;
+            exit(1);
+        }
+        apply_scene(*scene, render);
+        options.viewport = scene->viewport;
+    } else if (arg == "--precision") {
+        std::string p = next_arg(i, argc, argv);
+        std::optional<Precision> precision = parse_precision(p);
+        if (!precision) {
+            std::cerr << "Unknown precision: " << p << std::endl;
+            exit(1);
+        }
+        render.precision = *precision;
+    } else if (arg == "--report") {
+        options.report = next_arg(i, argc, argv);
+        if (options.report != "json") {
+            std::cerr << "Unknown report format: " << options.report << std::endl;
+            exit(1);
+        }
+    } else if (arg == "--trace") {
+        options.trace_file = next_arg(i, argc, argv);
+    } else if (arg == "--cost-map") {
+        options.cost_map_file = next_arg(i, argc, argv);
+    } else if (arg == "--perf") {
+        options.perf = true;
+    } else if (arg == "--energy") {
+        options.energy = true;
+    } else if (arg == "--memory") {
+        options.memory = true;
+    } else if (arg == "--dry-run") {
+        options.dry_run = true;
+    } else if (arg == "--bench") {
+        parse_workloads(next_arg(i, argc, argv), options.bench);
+    } else if (arg == "--diff") {
+        parse_workloads(next_arg(i, argc, argv), options.bench);
+        options.diff = true;
+    } else if (arg == "--diff-reference") {
+        std::string name = next_arg(i, argc, argv);
+        options.diff_reference = parse_precision(name);
+        if (!options.diff_reference) {
+            std::cerr << "Unknown precision: " << name << std::endl;
+            exit(1);
+        }
+    } else if (arg == "--diff-output") {
+        options.diff_output = next_arg(i, argc, argv);
+    } else if (arg == "--repetitions") {
+        options.bench.repetitions = std::stoi(next_arg(i, argc, argv));
+        if (options.bench.repetitions < 1) {
+            std::cerr << "Need at least one repetition" << std::endl;
+            exit(1);
+        }
+    } else if (arg == "--warmup") {
+        options.bench.warmup = std::stoi(next_arg(i, argc, argv));
+    } else if (arg == "--bench-output") {
+        options.bench.output_file = next_arg(i, argc, argv);
+    } else if (arg == "--bench-label") {
+        options.bench.label = next_arg(i, argc, argv);
+    } else if (arg == "--bench-allow-mismatch") {
+        options.bench.allow_mismatch = true;
+    } else if (arg == "--jobs") {
+        options.jobs_file = next_arg(i, argc, argv);
+    } else if (arg == "--serve") {
+        options.serve_address = next_arg(i, argc, argv);
+    } else if (arg == "--pyramid") {
+        options.pyramid.path = next_arg(i, argc, argv);
+    } else if (arg == "--pyramid-layout") {
+        std::string name = next_arg(i, argc, argv);
+        std::optional<PyramidLayout> layout = parse_pyramid_layout(name);
+        if (!layout) {
+            std::cerr << "Unknown pyramid layout: " << name << std::endl;
+            exit(1);
+        }
+        options.pyramid.layout = *layout;
+    } else if (arg == "--tile-size") {
+        options.pyramid.tile_size = std::stoul(next_arg(i, argc, argv));
+    } else if (arg == "--coordinate") {
+        options.cluster.address = next_arg(i, argc, argv);
+    } else if (arg == "--spawn-workers") {
+        options.cluster.spawn_workers = std::stoi(next_arg(i, argc, argv));
+    } else if (arg == "--worker") {
+        options.worker_address = next_arg(i, argc, argv);
+    } else if (arg == "--prefetch") {
+        options.prefetch = std::stoul(next_arg(i, argc, argv));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void print_common_help(const FrontendOptions& defaults) {
+    std::cout << "  --width, -w <width>        Specify the width of the image. Default is " << defaults.render.width << ".\n";
+    std::cout << "  --height, -h <height>      Specify the height of the image. Default is " << defaults.render.height << ".\n";
+    std::cout << "  --output, -o <filename>    Specify the output filename. Default is " << defaults.output_file << ".\n";
+    std::cout << "                             Supported formats: PNG, JPG, BMP.\n";
+    std::cout << "  --max-iter, -i <n>         Maximum number of iterations per pixel. Default is " << defaults.render.max_iteration << ".\n";
+    std::cout << "  --viewport <l>,<r>,<b>,<t> Region of the complex plane to render. Default is -2,1,-1.5,1.5.\n";
+    std::cout << "  --mode, -m <mode>          Rendering mode: escape (escape time) or distance (exterior\n";
+    std::cout << "                             distance estimate, line-art style). Default is escape.\n";
+    std::cout << "  --fractal, -f <fractal>    Fractal to render: mandelbrot, julia, multibrot, burning-ship\n";
+    std::cout << "                             or tricorn. Default is mandelbrot.\n";
+    std::cout << "  --julia <re>,<im>          Constant c used by the julia fractal. Default is -0.8,0.156.\n";
+    std::cout << "  --power, -p <d>            Exponent used by the multibrot fractal (2 to 8). Default is 3.\n";
+    std::cout << "  --scene <name>             Use the size, view and settings of a catalog scene:";
+    for (const Scene& scene : scene_catalog()) {
+        std::cout << " " << scene.name;
+    }
+    std::cout << ".\n";
+    std::cout << "  --precision <p>            Iterate in single or double precision (cpu only, for deep zooms).\n";
+    std::cout << "                             Default is single.\n";
+    std::cout << "  --report json              Print phase timings, pixel and iteration counts and the config as\n";
+    std::cout << "                             JSON instead of the elapsed time.\n";
+    std::cout << "  --trace <out.json>         Write a Chrome trace-event timeline of the run (not with --serve).\n";
+    std::cout << "  --perf                     Count cycles, instructions, cache and branch misses per phase and\n";
+    std::cout << "                             thread with perf_event_open.\n";
+    std::cout << "  --energy                   Read package and DRAM energy per phase from RAPL in\n";
+    std::cout << "                             /sys/class/powercap and print joules per frame and pixels per joule.\n";
+    std::cout << "  --memory                   Print the high-water marks of the frame, image and PNG row buffers\n";
+    std::cout << "                             and of RSS per phase.\n";
+    std::cout << "  --dry-run                  Print the memory the render would need, without rendering. Exits\n";
+    std::cout << "                             with 1 if it exceeds the available memory. Single images only.\n";
+    std::cout << "  --cost-map <out.png|csv>   Record iterations, time and worker of every row, write them as a\n";
+    std::cout << "                             heatmap or CSV and print the load imbalance across workers.\n";
+    std::cout << "  --bench <scenes|sizes>     Benchmark catalog scenes (names or all) or square renders of the\n";
+    std::cout << "                             view at each size (1024,2048 or first:last:step) instead of saving\n";
+    std::cout << "                             an image. See README.\n";
+    std::cout << "  --repetitions <n>          Timed renders per size. Default is " << defaults.bench.repetitions << ".\n";
+    std::cout << "  --warmup <n>               Untimed renders per size before those. Default is " << defaults.bench.warmup << ".\n";
+    std::cout << "  --bench-output <file>      File the benchmark results are appended to, one JSON document per\n";
+    std::cout << "                             line for .json and CSV otherwise.\n";
+    std::cout << "                             Default is " << defaults.bench.output_file << ".\n";
+    std::cout << "  --bench-label <name>       Name of this configuration in the results. Default is the backend.\n";
+    std::cout << "  --bench-allow-mismatch     Exit with 0 even if frames do not match the scene checksums.\n";
+    std::cout << "  --diff <scenes|sizes>      Like --bench, but also render on the CPU and report the time of both,\n";
+    std::cout << "                             the pixels that differ and the largest difference.\n";
+    std::cout << "  --diff-reference <p>       Precision of the CPU reference: single or double. Default is the\n";
+    std::cout << "                             scene's own.\n";
+    std::cout << "  --diff-output <prefix>     Diff images go to <prefix>-<scene or size>.png. Default is "
+              << defaults.diff_output << ".\n";
+    std::cout << "  --jobs <file.yaml>         Render every job listed in a YAML file in one process. See README.\n";
+    std::cout << "  --serve <address>          Serve 256x256 XYZ tiles as /z/x/y.png over HTTP on host:port or\n";
+    std::cout << "                             unix:/path/to/socket.\n";
+    std::cout << "  --prefetch <n>             Tiles the server may render speculatively while idle. 0 disables\n";
+    std::cout << "                             prefetch. Default is " << defaults.prefetch << ".\n";
+    std::cout << "  --pyramid <path>           Write the image as a tile pyramid: <path>.dzi and <path>_files/,\n";
+    std::cout << "                             or <path>/z/x/y.png with --pyramid-layout xyz.\n";
+    std::cout << "  --pyramid-layout <layout>  dzi or xyz. Default is dzi.\n";
+    std::cout << "  --tile-size <n>            Edge length of pyramid tiles, even. Default is " << defaults.pyramid.tile_size << ".\n";
+    std::cout << "  --coordinate <address>     Render on worker processes connecting to host:port or\n";
+    std::cout << "                             unix:/path/to/socket, streaming bands into a PNG output.\n";
+    std::cout << "  --spawn-workers <n>        With --coordinate, also start n local workers.\n";
+    std::cout << "  --worker <address>         Render bands for the coordinator at address.\n";
+    std::cout << "  --help                     Display this help message.\n";
+}
+
+static int run(Renderer& renderer, const FrontendOptions& options) {
+    // The estimate only covers a single image render, and the other modes must not render for real instead
+    if(options.dry_run
+        && (!options.jobs_file.empty() || !options.serve_address.empty() || !options.worker_address.empty()
+            || !options.bench.sizes.empty() || !options.bench.scenes.empty() || !options.pyramid.path.empty()
+            || !options.cluster.address.empty())) {
+        std::cerr << "--dry-run only supports single image renders, not --jobs, --serve, --worker, --bench, --diff, "
+                  << "--pyramid or --coordinate" << std::endl;
+        return 1;
+    }
+    if(!options.jobs_file.empty()) {
+        std::vector<Job> jobs;
+        try {
+            jobs = load_jobs(options.jobs_file, options);
+        } catch(const std::runtime_error& e) {
+            std::cerr << "Failed to load jobs: " << e.what() << std::endl;
+            return 1;
+        }
+        return run_jobs(renderer, jobs);
+    }
+    if(!options.serve_address.empty()) {
+        return run_tile_server(renderer, TileServerOptions{
+            .address = options.serve_address, .render = options.render, .prefetch = options.prefetch});
+    }
+    if(!options.worker_address.empty()) {
+        return run_worker(renderer, options.worker_address);
+    }
+
+    const Viewport viewport = options.viewport.value_or(default_viewport(options.render.fractal));
+    if(!options.bench.sizes.empty() || !options.bench.scenes.empty()) {
+        BenchOptions bench = options.bench;
+        bench.render = options.render;
+        bench.viewport = viewport;
+        if(options.diff) {
+            return run_diff(renderer, DiffOptions{.bench = bench, .reference_precision = options.diff_reference,
+                .output_prefix = options.diff_output, .json = options.report == "json"});
+        }
+        return run_benchmark(renderer, bench);
+    }
+    if(!options.pyramid.path.empty()) {
+        return run_pyramid(renderer, viewport, options.render, options.pyramid);
+    }
+    if(!options.cluster.address.empty()) {
+        return run_coordinator(viewport, options.render, options.output_file, options.cluster);
+    }
+
+    if(options.dry_run) {
+        const MemoryEstimate estimate = estimate_memory(options.render, renderer.backend(), options.output_file);
+        print_estimate(std::cout, estimate);
+        return estimate.available && estimate.total() > estimate.available ? 1 : 0;
+    }
+
+    PerfProfile profile;
+    RenderOptions render_options = options.render;
+    if(options.perf)
+        render_options.perf = &profile;
+    EnergyProfile energy;
+    if(options.energy)
+        render_options.energy = &energy;
+    MemoryProfile memory;
+    if(options.memory)
+        render_options.memory = &memory;
+    CostMap cost;
+    if(!options.cost_map_file.empty())
+        render_options.cost = &cost;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const Frame& frame = renderer.render(viewport, render_options);
+    if(options.report.empty()) {
+        std::cout << "Elapsed time: " << frame.compute_seconds << " seconds" << std::endl;
+        std::cout << "Throughput: ";
+        print_throughput(std::cout, measure_throughput(frame, renderer.backend().peak_gflops(render_options.precision)));
+        std::cout << std::endl;
+    }
+
+    const RgbBuffer& image = renderer.colorize();
+    // Encoders stream into the file, so this phase includes writing it
+    auto encode_start = std::chrono::high_resolution_clock::now();
+    bool ok;
+    {
+        TRACE_ZONE("encode");
+        PerfScope counters(render_options.perf, "encode", 0);
+        EnergyScope joules(render_options.energy, "encode");
+        MemoryScope bytes(render_options.memory, "encode");
+        ok = save_image(options.output_file, frame.width, frame.height, 3, image.data(), frame.width * 3);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    if(!ok) {
+        std::cerr << "Failed to save image." << std::endl;
+        return 1;
+    }
+    std::optional<Imbalance> imbalance;
+    if(render_options.cost) {
+        if(!write_cost_map(options.cost_map_file, cost, frame)) {
+            std::cerr << "Failed to write cost map " << options.cost_map_file << std::endl;
+            return 1;
+        }
+        imbalance = analyze(cost);
+    }
+
+    if(options.report == "json") {
+        RenderReport report = make_report(frame, options.render, renderer.backend(), options.output_file);
+        if(options.perf)
+            report.counters = &profile;
+        if(options.energy)
+            report.energy = &energy;
+        if(options.memory)
+            report.memory = &memory;
+        report.imbalance = imbalance;
+        report.encode_seconds = std::chrono::duration<double>(end - encode_start).count();
+        report.wall_seconds = std::chrono::duration<double>(end - start).count();
+        write_json(std::cout, report);
+    } else {
+        if(options.perf)
+            profile.print(std::cout, uint64_t(frame.width) * frame.height);
+        if(options.energy)
+            energy.print(std::cout, uint64_t(frame.width) * frame.height);
+        if(options.memory)
+            memory.print(std::cout);
+        if(imbalance)
+            print_imbalance(std::cout, *imbalance);
+    }
+    return 0;
+}
+
+// Options the library rejects, such as distance mode for a fractal without a derivative, surface as exceptions
+static int run_checked(Renderer& renderer, const FrontendOptions& options) {
+    try {
+        return run(renderer, options);
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+int run_frontend(Renderer& renderer, const FrontendOptions& options) {
+    if(options.trace_file.empty())
+        return run_checked(renderer, options);
+
+    start_trace();
+    int status = run_checked(renderer, options);
+    if(!write_trace(options.trace_file)) {
+        std::cerr << "Failed to write trace " << options.trace_file << std::endl;
+        return 1;
+    }
+    return status;
+}
+
+}
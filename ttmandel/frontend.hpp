@@ -0,0 +1,77 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "bench.hpp"
+#include "distributed.hpp"
+#include "pyramid.hpp"
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+// Options shared by every executable. Each executable parses its own extras (device id, thread count, ...) and
+// hands everything else to parse_common_arg().
+struct FrontendOptions {
+    RenderOptions render;
+    std::optional<Viewport> viewport;
+    std::string output_file = "mandelbrot.png";
+    // When set, render every job in this YAML file instead of a single image
+    std::string jobs_file;
+    // When set, serve XYZ map tiles on this address instead of rendering an image
+    std::string serve_address;
+    // Prefetch queue length of the tile server, 0 disables prefetch
+    size_t prefetch = 32;
+    // When pyramid.path is set, write a DZI or XYZ tile pyramid of the image instead of a single file
+    PyramidOptions pyramid;
+    // When cluster.address is set, render on worker processes as their coordinator
+    ClusterOptions cluster;
+    // When bench.scenes or bench.sizes is set, benchmark the backend instead of rendering an image. Its render options and
+    // viewport come from the ones above.
+    BenchOptions bench;
+    // Compare the bench scenes or sizes against a CPU reference instead of benchmarking them
+    bool diff = false;
+    // Precision of the CPU reference, the workload's own when unset
+    std::optional<Precision> diff_reference;
+    std::string diff_output = "diff";
+    // When set, render bands for the coordinator at this address instead of rendering an image
+    std::string worker_address;
+    // Print a machine readable report instead of the elapsed time. Only "json" so far.
+    std::string report;
+    // Collect hardware performance counters per phase and thread
+    bool perf = false;
+    // Measure RAPL package and DRAM energy per phase
+    bool energy = false;
+    // Record buffer and RSS high-water marks per phase
+    bool memory = false;
+    // Print the memory the render would need instead of rendering
+    bool dry_run = false;
+    // When set, record per-row cost and write it to this file, as a heatmap for .png and CSV otherwise
+    std::string cost_map_file;
+    // When set, write a Chrome trace of the run to this file
+    std::string trace_file;
+};
+
+std::string next_arg(int& i, int argc, char** argv);
+
+std::optional<RenderMode> parse_render_mode(std::string_view name);
+std::optional<FractalType> parse_fractal_type(std::string_view name);
+std::optional<Precision> parse_precision(std::string_view name);
+std::optional<PyramidLayout> parse_pyramid_layout(std::string_view name);
+// Inverses of the parsers above
+std::string render_mode_name(RenderMode mode);
+std::string fractal_type_name(FractalType type);
+std::string precision_name(Precision precision);
+
+// Consumes argv[i] (and its value) if it is a common option. Returns false for arguments it does not know so the
+// caller can report them.
+bool parse_common_arg(std::string_view arg, int& i, int argc, char** argv, FrontendOptions& options);
+
+void print_common_help(const FrontendOptions& defaults);
+
+// Renders, colorizes and saves one image (or every job of options.jobs_file, serves tiles, coordinates workers or
+// works for a coordinator) as described by `options`. Returns the process exit code.
+int run_frontend(Renderer& renderer, const FrontendOptions& options);
+
+}
@@ -0,0 +1,172 @@
+#include "jobs.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+
+#include <yaml-cpp/yaml.h>
+
+#include "report.hpp"
+#include "scenes.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+struct JobSpec {
+    std::optional<Viewport> viewport;
+    RenderOptions options;
+    std::string output_file;
+};
+
+void apply_keys(const YAML::Node& node, JobSpec& spec, const std::string& where) {
+    if(!node.IsMap())
+        throw std::runtime_error(where + ": expected a map");
+
+    for(const auto& entry : node) {
+        const std::string key = entry.first.as<std::string>();
+        const YAML::Node& value = entry.second;
+        if(key == "width") {
+            spec.options.width = value.as<size_t>();
+        } else if(key == "height") {
+            spec.options.height = value.as<size_t>();
+        } else if(key == "max_iter") {
+            spec.options.max_iteration = value.as<int>();
+        } else if(key == "output") {
+            spec.output_file = value.as<std::string>();
+        } else if(key == "viewport") {
+            if(!value.IsSequence() || value.size() != 4)
+                throw std::runtime_error(where + ": viewport must be [left, right, bottom, top]");
+            spec.viewport = Viewport{value[0].as<double>(), value[1].as<double>(), value[2].as<double>(), value[3].as<double>()};
+        } else if(key == "mode") {
+            std::optional<RenderMode> mode = parse_render_mode(value.as<std::string>());
+            if(!mode)
+                throw std::runtime_error(where + ": unknown mode " + value.as<std::string>());
+            spec.options.mode = *mode;
+        } else if(key == "fractal") {
+            std::optional<FractalType> type = parse_fractal_type(value.as<std::string>());
+            if(!type)
+                throw std::runtime_error(where + ": unknown fractal " + value.as<std::string>());
+            spec.options.fractal.type = *type;
+        } else if(key == "julia") {
+            if(!value.IsSequence() || value.size() != 2)
+                throw std::runtime_error(where + ": julia must be [re, im]");
+            spec.options.fractal.julia_real = value[0].as<float>();
+            spec.options.fractal.julia_imag = value[1].as<float>();
+        } else if(key == "scene") {
+            // Later keys of the same job override the scene's settings
+            const Scene* scene = find_scene(value.as<std::string>());
+            if(!scene)
+                throw std::runtime_error(where + ": unknown scene " + value.as<std::string>());
+            apply_scene(*scene, spec.options);
+            spec.viewport = scene->viewport;
+        } else if(key == "precision") {
+            std::optional<Precision> precision = parse_precision(value.as<std::string>());
+            if(!precision)
+                throw std::runtime_error(where + ": unknown precision " + value.as<std::string>());
+            spec.options.precision = *precision;
+        } else if(key == "power") {
+            spec.options.fractal.power = value.as<int>();
+            if(spec.options.fractal.power < 2 || spec.options.fractal.power > 8)
+                throw std::runtime_error(where + ": multibrot power must be between 2 and 8");
+        } else {
+            throw std::runtime_error(where + ": unknown key " + key);
+        }
+    }
+}
+
+// Same, with the location added to yaml-cpp's conversion errors, which only know the line
+void apply(const YAML::Node& node, JobSpec& spec, const std::string& where) {
+    try {
+        apply_keys(node, spec, where);
+    } catch(const YAML::Exception& e) {
+        throw std::runtime_error(where + ": " + e.what());
+    }
+}
+
+}
+
+std::vector<Job> load_jobs(const std::string& path, const FrontendOptions& base) {
+    YAML::Node root;
+    try {
+        root = YAML::LoadFile(path);
+    } catch(const YAML::Exception& e) {
+        throw std::runtime_error(path + ": " + e.what());
+    }
+    if(!root.IsMap())
+        throw std::runtime_error(path + ": expected a map with a 'jobs' list");
+
+    JobSpec defaults{base.viewport, base.render, ""};
+    if(root["defaults"])
+        apply(root["defaults"], defaults, path + ": defaults");
+
+    const YAML::Node& list = root["jobs"];
+    if(!list || !list.IsSequence())
+        throw std::runtime_error(path + ": expected a 'jobs' list");
+
+    std::vector<Job> jobs;
+    jobs.reserve(list.size());
+    for(size_t i = 0; i < list.size(); ++i) {
+        const std::string where = path + ": job " + std::to_string(i);
+        JobSpec spec = defaults;
+        apply(list[i], spec, where);
+        if(spec.output_file.empty())
+            throw std::runtime_error(where + ": missing output");
+        jobs.push_back({spec.viewport.value_or(default_viewport(spec.options.fractal)), spec.options, spec.output_file});
+    }
+    return jobs;
+}
+
+int run_jobs(Renderer& renderer, const std::vector<Job>& jobs) {
+    // Two RGB buffers: one being encoded in the background, one being filled by the current job
+    RgbBuffer images[2];
+    std::future<bool> pending;
+    const Job* pending_job = nullptr;
+    int failures = 0;
+
+    auto finish_pending = [&]() {
+        if(pending.valid() && !pending.get()) {
+            std::cerr << "Failed to save image " << pending_job->output_file << "." << std::endl;
+            failures++;
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < jobs.size(); ++i) {
+        const Job& job = jobs[i];
+        TRACE_ZONE_ID("job", i);
+        const Frame& frame = renderer.render(job.viewport, job.options);
+        std::cout << "[" << i + 1 << "/" << jobs.size() << "] " << job.output_file
+                  << ": Elapsed time: " << frame.compute_seconds << " seconds, ";
+        print_throughput(std::cout, measure_throughput(frame, renderer.backend().peak_gflops(job.options.precision)));
+        std::cout << std::endl;
+
+        RgbBuffer& image = images[i % 2];
+        renderer.colorize(image);
+
+        // The other buffer is only free again once the previous job is written out
+        finish_pending();
+        pending_job = &job;
+        pending = std::async(std::launch::async, [&image, &job, i]() {
+            TRACE_ZONE_ID("save", i);
+            std::filesystem::path parent = std::filesystem::path(job.output_file).parent_path();
+            if(!parent.empty())
+                std::filesystem::create_directories(parent);
+            const size_t width = job.options.width;
+            return save_image(job.output_file, width, job.options.height, 3, image.data(), width * 3);
+        });
+    }
+    finish_pending();
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Rendered " << jobs.size() << " jobs in "
+              << std::chrono::duration<double>(end - start).count() << " seconds" << std::endl;
+
+    return failures == 0 ? 0 : 1;
+}
+
+}
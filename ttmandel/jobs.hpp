@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "frontend.hpp"
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct Job {
+    Viewport viewport;
+    RenderOptions options;
+    std::string output_file;
+};
+
+// Loads a batch of jobs from a YAML file of the form
+//
+//   defaults:                 # optional, applies to every job
+//     width: 1024
+//     max_iter: 256
+//   jobs:
+//     - output: overview.png
+//     - output: seahorse.png
+//       viewport: [-0.80, -0.70, 0.05, 0.15]   # left, right, bottom, top
+//       fractal: mandelbrot                    # also: mode, julia: [re, im], power, height
+//
+// Settings not given in the file fall back to `base`, i.e. the command line. Throws std::runtime_error naming the
+// file and job when the file cannot be read or a setting is invalid.
+std::vector<Job> load_jobs(const std::string& path, const FrontendOptions& base);
+
+// Renders the jobs in order on a single Renderer. Encoding and writing job N runs on a background thread while job
+// N+1 is rendered. Returns the process exit code.
+int run_jobs(Renderer& renderer, const std::vector<Job>& jobs);
+
+}
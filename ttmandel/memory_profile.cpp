@@ -0,0 +1,181 @@
+#include "memory_profile.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "report.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+// "VmHWM:    1234 kB" style fields of /proc/self/status and /proc/meminfo, in bytes. 0 when missing.
+size_t read_kb_field(const char* path, const std::string& field) {
+    std::ifstream in(path);
+    std::string line;
+    while(std::getline(in, line)) {
+        if(line.starts_with(field + ":"))
+            return std::stoull(line.substr(field.size() + 1)) * 1024;
+    }
+    return 0;
+}
+
+// Writing 5 to clear_refs resets VmHWM to the current RSS (Linux 4.0 and later)
+void reset_rss_peak() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+std::string mib(size_t bytes) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << bytes / double(1 << 20) << " MiB";
+    return out.str();
+}
+
+}
+
+MemoryPeaks& MemoryPeaks::operator|=(const MemoryPeaks& other) {
+    for(size_t i = 0; i < memory_class_count; ++i)
+        bytes[i] = std::max(bytes[i], other.bytes[i]);
+    tracked = std::max(tracked, other.tracked);
+    rss = std::max(rss, other.rss);
+    return *this;
+}
+
+void MemoryProfile::add(const std::string& phase, const MemoryPeaks& peaks) {
+    auto it = std::find_if(phases_.begin(), phases_.end(), [&](const Phase& p) { return p.name == phase; });
+    if(it == phases_.end())
+        phases_.push_back({phase, peaks});
+    else
+        it->peaks |= peaks;
+}
+
+MemoryPeaks MemoryProfile::total() const {
+    MemoryPeaks peaks;
+    for(const Phase& phase : phases_)
+        peaks |= phase.peaks;
+    peaks.rss = std::max(peaks.rss, peak_rss_bytes());
+    return peaks;
+}
+
+void MemoryProfile::print(std::ostream& out) const {
+    auto print_row = [&](const std::string& label, const MemoryPeaks& p) {
+        out << std::left << std::setw(14) << label << std::right;
+        for(size_t bytes : p.bytes)
+            out << std::setw(12) << mib(bytes);
+        out << std::setw(12) << mib(p.tracked) << std::setw(12) << (p.rss ? mib(p.rss) : "n/a") << "\n";
+    };
+
+    out << std::left << std::setw(14) << "phase" << std::right;
+    for(const char* name : memory_class_names)
+        out << std::setw(12) << name;
+    out << std::setw(12) << "tracked" << std::setw(12) << "RSS" << "\n";
+    for(const Phase& phase : phases_)
+        print_row(phase.name, phase.peaks);
+    print_row("peak", total());
+}
+
+void MemoryProfile::write_json(std::ostream& out) const {
+    auto write_peaks = [&](const MemoryPeaks& p) {
+        out << "{";
+        for(size_t i = 0; i < memory_class_count; ++i)
+            out << "\"" << memory_class_names[i] << "\": " << p.bytes[i] << ", ";
+        out << "\"tracked\": " << p.tracked << ", \"rss\": ";
+        if(p.rss)
+            out << p.rss;
+        else
+            out << "null";
+        out << "}";
+    };
+
+    out << "{\"phases\": {";
+    for(size_t i = 0; i < phases_.size(); ++i) {
+        out << (i ? ", " : "") << json_string(phases_[i].name) << ": ";
+        write_peaks(phases_[i].peaks);
+    }
+    out << "}, \"peak\": ";
+    write_peaks(total());
+    out << "}";
+}
+
+MemoryScope::MemoryScope(MemoryProfile* profile, const char* phase)
+    : profile(profile), phase(phase) {
+    if(!profile)
+        return;
+    reset_memory_peaks();
+    reset_rss_peak();
+}
+
+MemoryScope::~MemoryScope() {
+    if(!profile)
+        return;
+    MemoryPeaks peaks;
+    for(size_t i = 0; i < memory_class_count; ++i)
+        peaks.bytes[i] = memory_counters.peak[i].load();
+    peaks.tracked = memory_counters.total_peak.load();
+    peaks.rss = peak_rss_bytes();
+    profile->add(phase, peaks);
+}
+
+size_t current_rss_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages, resident;
+    if(statm >> pages >> resident)
+        return resident * sysconf(_SC_PAGESIZE);
+    return 0;
+}
+
+size_t peak_rss_bytes() {
+    if(size_t hwm = read_kb_field("/proc/self/status", "VmHWM"))
+        return hwm;
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+        return size_t(usage.ru_maxrss) * 1024;
+    return 0;
+}
+
+size_t MemoryEstimate::total() const {
+    size_t sum = baseline;
+    for(size_t b : bytes)
+        sum += b;
+    return sum;
+}
+
+MemoryEstimate estimate_memory(const RenderOptions& options, const Backend& backend, const std::string& output_file) {
+    MemoryEstimate estimate;
+    const size_t pixels = options.width * options.height;
+    if(options.mode == RenderMode::Distance)
+        estimate.bytes[size_t(MemoryClass::Distance)] = pixels * sizeof(float);
+    else
+        estimate.bytes[size_t(MemoryClass::Iterations)] = pixels * sizeof(int32_t);
+    estimate.bytes[size_t(MemoryClass::Rgb)] = pixels * 3;
+    // Encoders stream into the file, only PNG keeps a table of row pointers
+    if(output_file.ends_with(".png"))
+        estimate.bytes[size_t(MemoryClass::PngRows)] = options.height * sizeof(void*);
+    estimate.bytes[size_t(MemoryClass::Device)] = backend.host_bytes(options);
+    estimate.baseline = current_rss_bytes();
+    estimate.available = read_kb_field("/proc/meminfo", "MemAvailable");
+    return estimate;
+}
+
+void print_estimate(std::ostream& out, const MemoryEstimate& estimate) {
+    for(size_t i = 0; i < memory_class_count; ++i) {
+        if(estimate.bytes[i])
+            out << std::left << std::setw(14) << memory_class_names[i] << std::right << std::setw(14)
+                << mib(estimate.bytes[i]) << "\n";
+    }
+    out << std::left << std::setw(14) << "baseline" << std::right << std::setw(14) << mib(estimate.baseline)
+        << "  (resident now)\n";
+    out << std::left << std::setw(14) << "total" << std::right << std::setw(14) << mib(estimate.total());
+    if(estimate.available)
+        out << "  of " << mib(estimate.available) << " available"
+            << (estimate.total() > estimate.available ? ", DOES NOT FIT" : "");
+    out << "\n";
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "counting_allocator.hpp"
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct MemoryPeaks {
+    // High-water mark of each buffer class
+    std::array<size_t, memory_class_count> bytes{};
+    // High-water mark of all tracked buffers together
+    size_t tracked = 0;
+    // High-water mark of the resident set size, 0 when unknown
+    size_t rss = 0;
+
+    MemoryPeaks& operator|=(const MemoryPeaks& other);
+};
+
+// High-water marks of the tracked buffers and of RSS per phase, collected when RenderOptions::memory points at one.
+class MemoryProfile {
+public:
+    struct Phase {
+        std::string name;
+        MemoryPeaks peaks;
+    };
+
+    void add(const std::string& phase, const MemoryPeaks& peaks);
+
+    // Phases in the order they were first recorded
+    const std::vector<Phase>& phases() const { return phases_; }
+    // Highest marks over every phase, with the process' peak RSS
+    MemoryPeaks total() const;
+
+    void print(std::ostream& out) const;
+    void write_json(std::ostream& out) const;
+
+private:
+    std::vector<Phase> phases_;
+};
+
+// Records the high-water marks from construction to destruction as `phase` of `profile`. Does nothing when
+// `profile` is null. Resets the process' RSS high-water mark when the kernel allows it, so the peak RSS of a phase
+// is its own. Phases must not nest.
+class MemoryScope {
+public:
+    MemoryScope(MemoryProfile* profile, const char* phase);
+    ~MemoryScope();
+
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+
+private:
+    MemoryProfile* profile;
+    const char* phase;
+};
+
+size_t current_rss_bytes();
+size_t peak_rss_bytes();
+
+// Memory a single image render of `options` saved to `output_file` will need, predicted without rendering
+struct MemoryEstimate {
+    std::array<size_t, memory_class_count> bytes{};
+    // Resident set size before the render: code, libraries, device runtime and whatever was allocated so far
+    size_t baseline = 0;
+    // MemAvailable of the machine, 0 when unknown
+    size_t available = 0;
+
+    size_t total() const;
+};
+
+MemoryEstimate estimate_memory(const RenderOptions& options, const Backend& backend, const std::string& output_file);
+// Prints the estimate per class and whether it fits in the available memory
+void print_estimate(std::ostream& out, const MemoryEstimate& estimate);
+
+}
@@ -0,0 +1,138 @@
+#include "net.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace ttmandel {
+
+namespace {
+
+bool unix_address(const std::string& address, sockaddr_un& addr) {
+    const std::string path = address.substr(5);
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Unix socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+addrinfo* resolve(const std::string& address, int flags) {
+    size_t colon = address.rfind(':');
+    if(colon == std::string::npos) {
+        std::cerr << "Expected host:port or unix:/path, got " << address << std::endl;
+        return nullptr;
+    }
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = flags;
+    addrinfo* info = nullptr;
+    if(getaddrinfo(host.c_str(), port.c_str(), &hints, &info) != 0 || info == nullptr) {
+        std::cerr << "Cannot resolve " << address << std::endl;
+        return nullptr;
+    }
+    return info;
+}
+
+}
+
+int open_listener(const std::string& address) {
+    if(address.starts_with("unix:")) {
+        sockaddr_un addr;
+        if(!unix_address(address, addr))
+            return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(addr.sun_path);
+        if(fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+            std::cerr << "Failed to listen on " << address << ": " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo* info = resolve(address, AI_PASSIVE);
+    if(info == nullptr)
+        return -1;
+    int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    int one = 1;
+    if(fd >= 0)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(fd < 0 || bind(fd, info->ai_addr, info->ai_addrlen) != 0 || listen(fd, 128) != 0) {
+        std::cerr << "Failed to listen on " << address << ": " << std::strerror(errno) << std::endl;
+        freeaddrinfo(info);
+        return -1;
+    }
+    freeaddrinfo(info);
+    return fd;
+}
+
+int connect_to(const std::string& address) {
+    if(address.starts_with("unix:")) {
+        sockaddr_un addr;
+        if(!unix_address(address, addr))
+            return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::cerr << "Failed to connect to " << address << ": " << std::strerror(errno) << std::endl;
+            if(fd >= 0)
+                close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo* info = resolve(address, 0);
+    if(info == nullptr)
+        return -1;
+    int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if(fd < 0 || connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+        std::cerr << "Failed to connect to " << address << ": " << std::strerror(errno) << std::endl;
+        if(fd >= 0)
+            close(fd);
+        freeaddrinfo(info);
+        return -1;
+    }
+    freeaddrinfo(info);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+bool send_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while(size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool recv_all(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while(size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+}
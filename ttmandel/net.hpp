@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace ttmandel {
+
+// Socket helpers shared by the tile server and distributed rendering. Addresses are "host:port" for TCP or
+// "unix:/path/to/socket" for a unix domain socket. Errors are reported on stderr and return -1 / false.
+
+// Binds and listens on `address`. A stale unix socket file is replaced.
+int open_listener(const std::string& address);
+// Connects to `address`, with TCP_NODELAY set for TCP.
+int connect_to(const std::string& address);
+
+bool send_all(int fd, const void* data, size_t size);
+// Reads exactly `size` bytes. Returns false on error or if the peer closes first.
+bool recv_all(int fd, void* data, size_t size);
+
+}
@@ -0,0 +1,255 @@
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "report.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+constexpr uint64_t event_configs[counter_event_count] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+constexpr const char* event_names[counter_event_count] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+std::mutex reason_mutex;
+std::string unavailable_reason;
+
+// The counters of one thread, opened on first use and kept for the lifetime of the thread
+class ThreadCounters {
+public:
+    ThreadCounters() {
+        std::string reason;
+        for(size_t i = 0; i < counter_event_count; ++i) {
+            perf_event_attr attr = {};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = event_configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if(fds[i] < 0 && reason.empty())
+                reason = std::string(event_names[i]) + ": " + std::strerror(errno);
+        }
+        if(!reason.empty()) {
+            std::lock_guard lock(reason_mutex);
+            if(unavailable_reason.empty()) {
+                std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+                int level;
+                unavailable_reason = reason;
+                if(paranoid >> level)
+                    unavailable_reason += " (perf_event_paranoid = " + std::to_string(level) + ")";
+            }
+        }
+    }
+
+    ~ThreadCounters() {
+        for(int fd : fds) {
+            if(fd >= 0)
+                close(fd);
+        }
+    }
+
+    // Counters run from open onwards; phases are the difference between two reads
+    CounterValues read_all() const {
+        CounterValues values;
+        for(size_t i = 0; i < counter_event_count; ++i) {
+            uint64_t data[3];
+            if(fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != sizeof(data))
+                continue;
+            // Scale up when the PMU was multiplexed between more events than it has counters
+            values.value[i] = data[2] > 0 && data[2] < data[1] ? uint64_t(double(data[0]) * data[1] / data[2]) : data[0];
+            values.available[i] = true;
+        }
+        return values;
+    }
+
+private:
+    int fds[counter_event_count];
+};
+
+ThreadCounters& thread_counters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+CounterValues difference(const CounterValues& end, const CounterValues& start) {
+    CounterValues d;
+    for(size_t i = 0; i < counter_event_count; ++i) {
+        d.available[i] = end.available[i] && start.available[i];
+        d.value[i] = d.available[i] ? end.value[i] - start.value[i] : 0;
+    }
+    return d;
+}
+
+bool any_available(const std::vector<PerfProfile::Phase>& phases) {
+    for(const PerfProfile::Phase& phase : phases) {
+        const CounterValues total = phase.total();
+        if(std::find(total.available.begin(), total.available.end(), true) != total.available.end())
+            return true;
+    }
+    return false;
+}
+
+void write_values_json(std::ostream& out, const CounterValues& values) {
+    out << "{";
+    for(size_t i = 0; i < counter_event_count; ++i) {
+        out << (i ? ", " : "") << "\"" << event_names[i] << "\": ";
+        if(values.available[i])
+            out << values.value[i];
+        else
+            out << "null";
+    }
+    out << "}";
+}
+
+}
+
+CounterValues& CounterValues::operator+=(const CounterValues& other) {
+    for(size_t i = 0; i < counter_event_count; ++i) {
+        value[i] += other.value[i];
+        available[i] = available[i] || other.available[i];
+    }
+    return *this;
+}
+
+CounterValues PerfProfile::Phase::total() const {
+    CounterValues sum;
+    for(const CounterValues& t : threads)
+        sum += t;
+    return sum;
+}
+
+void PerfProfile::add(const std::string& phase, int thread, const CounterValues& values) {
+    std::lock_guard lock(mutex);
+    auto it = std::find_if(phases_.begin(), phases_.end(), [&](const Phase& p) { return p.name == phase; });
+    if(it == phases_.end()) {
+        phases_.push_back({phase, {}});
+        it = phases_.end() - 1;
+    }
+    if(it->threads.size() <= size_t(thread))
+        it->threads.resize(thread + 1);
+    it->threads[thread] += values;
+}
+
+std::vector<PerfProfile::Phase> PerfProfile::phases() const {
+    std::lock_guard lock(mutex);
+    return phases_;
+}
+
+void PerfProfile::print(std::ostream& out, uint64_t pixels) const {
+    const std::vector<Phase> all = phases();
+    const std::string reason = perf_unavailable_reason();
+    if(!reason.empty())
+        out << "Hardware counters partly or fully unavailable: " << reason << "\n";
+    if(!any_available(all))
+        return;
+
+    auto print_row = [&](const std::string& label, const CounterValues& v) {
+        out << std::left << std::setw(14) << label << std::right;
+        for(size_t i = 0; i < counter_event_count; ++i) {
+            if(v.available[i])
+                out << std::setw(16) << v.value[i];
+            else
+                out << std::setw(16) << "n/a";
+        }
+        if(v.has(CounterEvent::Cycles) && v.has(CounterEvent::Instructions) && v[CounterEvent::Cycles] > 0)
+            out << std::setw(8) << std::fixed << std::setprecision(2)
+                << double(v[CounterEvent::Instructions]) / v[CounterEvent::Cycles] << std::defaultfloat;
+        else
+            out << std::setw(8) << "n/a";
+        for(CounterEvent e : {CounterEvent::CacheMisses, CounterEvent::BranchMisses}) {
+            if(v.has(e) && pixels > 0)
+                out << std::setw(12) << std::fixed << std::setprecision(4) << double(v[e]) / pixels << std::defaultfloat;
+            else
+                out << std::setw(12) << "n/a";
+        }
+        out << "\n";
+    };
+
+    out << std::left << std::setw(14) << "phase" << std::right;
+    for(const char* name : event_names)
+        out << std::setw(16) << name;
+    out << std::setw(8) << "IPC" << std::setw(12) << "cmiss/px" << std::setw(12) << "bmiss/px" << "\n";
+    for(const Phase& phase : all) {
+        print_row(phase.name, phase.total());
+        if(phase.threads.size() > 1) {
+            for(size_t t = 0; t < phase.threads.size(); ++t)
+                print_row("  thread " + std::to_string(t), phase.threads[t]);
+        }
+    }
+}
+
+void PerfProfile::write_json(std::ostream& out, uint64_t pixels) const {
+    const std::vector<Phase> all = phases();
+    const std::string reason = perf_unavailable_reason();
+    out << "{\"unavailable\": ";
+    if(reason.empty())
+        out << "null";
+    else
+        out << json_string(reason);
+    out << ", \"phases\": {";
+    if(!any_available(all)) {
+        out << "}}";
+        return;
+    }
+    for(size_t p = 0; p < all.size(); ++p) {
+        const CounterValues total = all[p].total();
+        out << (p ? ", " : "") << json_string(all[p].name) << ": {\"total\": ";
+        write_values_json(out, total);
+        out << ", \"ipc\": ";
+        if(total.has(CounterEvent::Cycles) && total.has(CounterEvent::Instructions) && total[CounterEvent::Cycles] > 0)
+            out << double(total[CounterEvent::Instructions]) / total[CounterEvent::Cycles];
+        else
+            out << "null";
+        out << ", \"cache_misses_per_pixel\": ";
+        if(total.has(CounterEvent::CacheMisses) && pixels > 0)
+            out << double(total[CounterEvent::CacheMisses]) / pixels;
+        else
+            out << "null";
+        out << ", \"branch_misses_per_pixel\": ";
+        if(total.has(CounterEvent::BranchMisses) && pixels > 0)
+            out << double(total[CounterEvent::BranchMisses]) / pixels;
+        else
+            out << "null";
+        out << ", \"threads\": [";
+        for(size_t t = 0; t < all[p].threads.size(); ++t) {
+            out << (t ? ", " : "");
+            write_values_json(out, all[p].threads[t]);
+        }
+        out << "]}";
+    }
+    out << "}}";
+}
+
+PerfScope::PerfScope(PerfProfile* profile, const char* phase, int thread)
+    : profile(profile), phase(phase), thread(thread) {
+    if(profile)
+        start = thread_counters().read_all();
+}
+
+PerfScope::~PerfScope() {
+    if(profile)
+        profile->add(phase, thread, difference(thread_counters().read_all(), start));
+}
+
+std::string perf_unavailable_reason() {
+    std::lock_guard lock(reason_mutex);
+    return unavailable_reason;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ttmandel {
+
+enum class CounterEvent {
+    Cycles,
+    Instructions,
+    CacheMisses,
+    BranchMisses,
+};
+constexpr size_t counter_event_count = 4;
+
+struct CounterValues {
+    std::array<uint64_t, counter_event_count> value{};
+    // Events the kernel refused to count (common in containers and VMs) stay unavailable
+    std::array<bool, counter_event_count> available{};
+
+    uint64_t operator[](CounterEvent event) const { return value[size_t(event)]; }
+    bool has(CounterEvent event) const { return available[size_t(event)]; }
+    CounterValues& operator+=(const CounterValues& other);
+};
+
+// Hardware counters per phase and per thread, collected through perf_event_open when RenderOptions::perf points at
+// one. Only user space events of the counting threads are recorded.
+class PerfProfile {
+public:
+    struct Phase {
+        std::string name;
+        // Indexed by OpenMP thread number; threads that did not take part stay empty
+        std::vector<CounterValues> threads;
+        CounterValues total() const;
+    };
+
+    void add(const std::string& phase, int thread, const CounterValues& values);
+
+    // Phases in the order they were first recorded
+    std::vector<Phase> phases() const;
+
+    // Per phase totals with IPC and misses per pixel, followed by the per-thread breakdown. Explains why nothing was
+    // recorded when counters are unavailable.
+    void print(std::ostream& out, uint64_t pixels) const;
+    void write_json(std::ostream& out, uint64_t pixels) const;
+
+private:
+    mutable std::mutex mutex;
+    std::vector<Phase> phases_;
+};
+
+// Counts the calling thread's events from construction to destruction as `phase` of `thread`. Does nothing when
+// `profile` is null or counters cannot be opened. The counters themselves are opened once per thread and reused.
+class PerfScope {
+public:
+    PerfScope(PerfProfile* profile, const char* phase, int thread);
+    ~PerfScope();
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    PerfProfile* profile;
+    const char* phase;
+    int thread;
+    CounterValues start;
+};
+
+// Why counters could not be opened, empty if they could (or nobody tried yet)
+std::string perf_unavailable_reason();
+
+}
@@ -0,0 +1,245 @@
+#include "pyramid.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+// Encodes and writes tiles on background threads, with at most `max_pending` in flight so the copies they hold stay
+// bounded.
+class TileWriter {
+public:
+    explicit TileWriter(size_t max_pending) : max_pending(max_pending) {}
+
+    void write(std::string path, size_t width, size_t height, RgbBuffer pixels) {
+        if(pending.size() >= max_pending)
+            wait_oldest();
+        pending.push_back(std::async(std::launch::async, [path = std::move(path), width, height,
+                                                             pixels = std::move(pixels)]() {
+            TRACE_ZONE("tile");
+            return save_image(path, width, height, 3, pixels.data(), width * 3);
+        }));
+        ++written;
+    }
+
+    // Waits for every tile. Returns the number that failed.
+    size_t finish() {
+        while(!pending.empty())
+            wait_oldest();
+        return failed;
+    }
+
+    size_t written = 0;
+
+private:
+    void wait_oldest() {
+        if(!pending.front().get())
+            ++failed;
+        pending.pop_front();
+    }
+
+    const size_t max_pending;
+    std::deque<std::future<bool>> pending;
+    size_t failed = 0;
+};
+
+// One level of the pyramid and the row of tiles it is filling
+struct Level {
+    // DZI level or XYZ zoom
+    int number;
+    size_t width;
+    size_t height;
+    // Rows [band_row, band_row + band_rows) of the level, width * 3 bytes each
+    RgbBuffer band{};
+    size_t band_row = 0;
+    size_t band_rows = 0;
+    // Downsampled band, handed to the next coarser level
+    RgbBuffer half{};
+};
+
+class Pyramid {
+public:
+    Pyramid(const PyramidOptions& options, size_t width, size_t height)
+        : options(options), writer(2 * std::max(1u, std::thread::hardware_concurrency())) {
+        const size_t tile = options.tile_size;
+        // DZI goes down to a single pixel, XYZ to a single tile
+        const size_t last = options.layout == PyramidLayout::Dzi ? 1 : tile;
+        levels.push_back({0, width, height});
+        while(levels.back().width > last || levels.back().height > last) {
+            const Level& finer = levels.back();
+            levels.push_back({0, (finer.width + 1) / 2, (finer.height + 1) / 2});
+        }
+        for(size_t i = 0; i < levels.size(); ++i) {
+            Level& level = levels[i];
+            level.number = int(levels.size() - 1 - i);
+            level.band.resize(tile * level.width * 3);
+            if(i + 1 < levels.size())
+                level.half.resize(tile / 2 * levels[i + 1].width * 3);
+        }
+    }
+
+    // Creates the directories of every level up front, so the writer threads never race to create them
+    void create_directories() {
+        for(const Level& level : levels) {
+            if(options.layout == PyramidLayout::Dzi) {
+                std::filesystem::create_directories(options.path + "_files/" + std::to_string(level.number));
+                continue;
+            }
+            for(size_t x = 0; x < columns(level); ++x)
+                std::filesystem::create_directories(
+                    options.path + "/" + std::to_string(level.number) + "/" + std::to_string(x));
+        }
+    }
+
+    // Appends `count` rows of the base level
+    void add_rows(const uint8_t* rgb, size_t count) { add_rows(0, rgb, count); }
+
+    // Waits for the last tiles. Returns the number of tiles that could not be written.
+    size_t finish() { return writer.finish(); }
+
+    bool write_descriptor() const {
+        if(options.layout != PyramidLayout::Dzi)
+            return true;
+        std::ofstream out(options.path + ".dzi");
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\"" << options.tile_size
+            << "\" Overlap=\"0\" Format=\"png\">\n"
+            << "  <Size Width=\"" << levels[0].width << "\" Height=\"" << levels[0].height << "\"/>\n"
+            << "</Image>\n";
+        return bool(out);
+    }
+
+    const std::vector<Level>& all_levels() const { return levels; }
+    size_t tiles_written() const { return writer.written; }
+
+private:
+    size_t columns(const Level& level) const { return (level.width + options.tile_size - 1) / options.tile_size; }
+
+    void add_rows(size_t index, const uint8_t* rgb, size_t count) {
+        Level& level = levels[index];
+        const size_t stride = level.width * 3;
+        while(count > 0) {
+            const size_t n = std::min(count, options.tile_size - level.band_rows);
+            std::copy_n(rgb, n * stride, level.band.data() + level.band_rows * stride);
+            level.band_rows += n;
+            rgb += n * stride;
+            count -= n;
+            if(level.band_rows == options.tile_size || level.band_row + level.band_rows == level.height)
+                flush(index);
+        }
+    }
+
+    void flush(size_t index) {
+        Level& level = levels[index];
+        TRACE_ZONE_ID("level", level.number);
+        write_tiles(level);
+        if(index + 1 < levels.size()) {
+            const size_t rows = downsample(level, levels[index + 1].width);
+            add_rows(index + 1, level.half.data(), rows);
+        }
+        level.band_row += level.band_rows;
+        level.band_rows = 0;
+    }
+
+    void write_tiles(const Level& level) {
+        const size_t tile = options.tile_size;
+        const size_t tile_y = level.band_row / tile;
+        const size_t stride = level.width * 3;
+        for(size_t tile_x = 0; tile_x < columns(level); ++tile_x) {
+            const size_t x0 = tile_x * tile;
+            const size_t width = std::min(tile, level.width - x0);
+            // XYZ viewers expect every tile to be full size
+            const size_t out_width = options.layout == PyramidLayout::Xyz ? tile : width;
+            const size_t out_height = options.layout == PyramidLayout::Xyz ? tile : level.band_rows;
+            RgbBuffer pixels(out_width * out_height * 3);
+            for(size_t y = 0; y < level.band_rows; ++y)
+                std::copy_n(level.band.data() + y * stride + x0 * 3, width * 3, pixels.data() + y * out_width * 3);
+
+            const std::string number = std::to_string(level.number);
+            std::string path = options.layout == PyramidLayout::Dzi
+                ? options.path + "_files/" + number + "/" + std::to_string(tile_x) + "_" + std::to_string(tile_y)
+                    + ".png"
+                : options.path + "/" + number + "/" + std::to_string(tile_x) + "/" + std::to_string(tile_y) + ".png";
+            writer.write(std::move(path), out_width, out_height, std::move(pixels));
+        }
+    }
+
+    // Averages each 2x2 block of the band into level.half, which is `width` pixels wide. Blocks cut off by the right
+    // or bottom edge of the level average the pixels they have. Returns the number of rows produced.
+    size_t downsample(Level& level, size_t width) {
+        TRACE_ZONE("downsample");
+        const size_t rows = (level.band_rows + 1) / 2;
+        const size_t stride = level.width * 3;
+        #pragma omp parallel for
+        for(size_t y = 0; y < rows; ++y) {
+            const uint8_t* top = level.band.data() + 2 * y * stride;
+            const uint8_t* bottom = 2 * y + 1 < level.band_rows ? top + stride : top;
+            uint8_t* out = level.half.data() + y * width * 3;
+            for(size_t x = 0; x < width; ++x) {
+                const size_t left = 2 * x * 3;
+                const size_t right = 2 * x + 1 < level.width ? left + 3 : left;
+                for(size_t c = 0; c < 3; ++c)
+                    out[x * 3 + c] = (top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c] + 2) / 4;
+            }
+        }
+        return rows;
+    }
+
+    const PyramidOptions& options;
+    std::vector<Level> levels;
+    TileWriter writer;
+};
+
+}
+
+int run_pyramid(Renderer& renderer, const Viewport& viewport, const RenderOptions& options,
+    const PyramidOptions& pyramid_options) {
+    if(pyramid_options.tile_size < 2 || pyramid_options.tile_size % 2) {
+        std::cerr << "Tile size must be even" << std::endl;
+        return 1;
+    }
+    Pyramid pyramid(pyramid_options, options.width, options.height);
+    pyramid.create_directories();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    double compute_seconds = 0.0;
+    RenderOptions band = options;
+    band.image_height = options.height;
+    for(size_t y = 0; y < options.height; y += pyramid_options.tile_size) {
+        TRACE_ZONE_ID("band", y / pyramid_options.tile_size);
+        band.row_offset = y;
+        band.height = std::min(pyramid_options.tile_size, options.height - y);
+        const RgbBuffer& rgb = renderer.render_rgb(viewport, band);
+        compute_seconds += renderer.frame().compute_seconds;
+        pyramid.add_rows(rgb.data(), band.height);
+    }
+    const size_t failed = pyramid.finish();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if(failed > 0 || !pyramid.write_descriptor()) {
+        std::cerr << "Failed to write " << (failed ? std::to_string(failed) + " tiles of " : "") << pyramid_options.path
+                  << std::endl;
+        return 1;
+    }
+    const std::vector<Level>& levels = pyramid.all_levels();
+    std::cout << "Wrote " << pyramid.tiles_written() << " tiles in " << levels.size() << " levels ("
+              << levels.back().number << " to " << levels.front().number << ") to " << pyramid_options.path
+              << (pyramid_options.layout == PyramidLayout::Dzi ? ".dzi" : "") << std::endl;
+    std::cout << "Elapsed time: " << std::chrono::duration<double>(end - start).count() << " seconds, "
+              << compute_seconds << " seconds of compute" << std::endl;
+    return 0;
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+enum class PyramidLayout {
+    // Deep Zoom: <path>.dzi and <path>_files/<level>/<column>_<row>.png, level 0 being 1x1 pixel
+    Dzi,
+    // Slippy map: <path>/<z>/<x>/<y>.png, zoom 0 being a single tile. Edge tiles are padded with black.
+    Xyz,
+};
+
+struct PyramidOptions {
+    // Output prefix for DZI, directory for XYZ. Empty renders a single image instead.
+    std::string path;
+    PyramidLayout layout = PyramidLayout::Dzi;
+    // Edge length of the tiles, even so every 2x2 block of a level lies within one band of tiles
+    size_t tile_size = 256;
+};
+
+// Renders an options.width x options.height image of `viewport` as a tile pyramid. The base level is rendered one
+// row of tiles at a time through RenderOptions::row_offset, so it matches a single render of the whole image. Each
+// coarser level is built by 2x2 box downsampling the rows of the level below as they complete, instead of rendering
+// it again. Only one row of tiles per level is held, and tiles are encoded and written on background threads.
+// Returns the process exit code.
+int run_pyramid(Renderer& renderer, const Viewport& viewport, const RenderOptions& options,
+    const PyramidOptions& pyramid);
+
+}
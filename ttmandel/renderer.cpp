@@ -0,0 +1,199 @@
+#include "renderer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+#include <omp.h>
+
+#include "cost_map.hpp"
+#include "energy.hpp"
+#include "memory_profile.hpp"
+#include "perf_counters.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+Renderer::Renderer(std::unique_ptr<Backend> backend)
+    : backend_(std::move(backend)) {}
+
+void Renderer::prepare(const Viewport& viewport, const RenderOptions& options) {
+    TRACE_ZONE("setup");
+    perf_ = options.perf;
+    energy_ = options.energy;
+    memory_ = options.memory;
+    PerfScope counters(perf_, "setup", 0);
+    EnergyScope energy(energy_, "setup");
+    MemoryScope memory(memory_, "setup");
+    auto start = std::chrono::high_resolution_clock::now();
+    const size_t n_pixels = options.width * options.height;
+    frame_.width = options.width;
+    frame_.height = options.height;
+    frame_.max_iteration = options.max_iteration;
+    frame_.mode = options.mode;
+    frame_.viewport = viewport;
+    frame_.colorize_seconds = 0.0;
+    // resize() keeps the old allocation when the new frame fits, which is the common case for repeated renders
+    if(options.mode == RenderMode::Distance) {
+        frame_.distance.resize(n_pixels);
+        frame_.iterations.clear();
+    }
+    else {
+        frame_.iterations.resize(n_pixels);
+        frame_.distance.clear();
+    }
+    if(options.cost) {
+        options.cost->rows.assign(options.height, RowCost{});
+        options.cost->workers = 1;
+        options.cost->iterations_recorded = false;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    allocation_seconds_ = std::chrono::duration<double>(end - start).count();
+}
+
+void Renderer::render_rows(const Viewport& viewport, const RenderOptions& options, size_t row_begin, size_t row_end) {
+    frame_.compute_seconds = 0.0;
+    frame_.setup_seconds = 0.0;
+    frame_.coordinate_seconds = 0.0;
+    frame_.readback_seconds = 0.0;
+    frame_.executed_iterations.reset();
+    frame_.lane_slots.reset();
+    {
+        // Device backends upload coordinates and read back inside render(), so this covers those phases too
+        EnergyScope energy(options.energy, "compute");
+        MemoryScope memory(options.memory, "compute");
+        backend_->render(viewport, options, row_begin, row_end, frame_);
+    }
+    if(options.cancel && options.cancel->load())
+        throw RenderCancelled();
+    // Backends that do not count iterations still leave them in escape time frames
+    CostMap* cost = options.cost && !options.cost->iterations_recorded ? options.cost : nullptr;
+    if(frame_.mode == RenderMode::EscapeTime && (!frame_.executed_iterations || cost)) {
+        uint64_t total = 0;
+        #pragma omp parallel for reduction(+:total)
+        for(size_t y = row_begin; y < row_end; ++y) {
+            const int32_t* row = frame_.iterations.data() + y * frame_.width;
+            uint64_t row_total = std::accumulate(row, row + frame_.width, uint64_t(0));
+            if(cost)
+                cost->rows[y].iterations = row_total;
+            total += row_total;
+        }
+        if(!frame_.executed_iterations)
+            frame_.executed_iterations = total;
+    }
+}
+
+const Frame& Renderer::render(const Viewport& viewport, const RenderOptions& options) {
+    TRACE_ZONE("render");
+    prepare(viewport, options);
+    render_rows(viewport, options, 0, options.height);
+    frame_.setup_seconds += allocation_seconds_;
+    return frame_;
+}
+
+void Renderer::colorize_rows(size_t row_begin, size_t row_end, RgbBuffer& rgb) {
+    TRACE_ZONE("colorize");
+    EnergyScope energy(energy_, "colorize");
+    MemoryScope memory(memory_, "colorize");
+    auto start = std::chrono::high_resolution_clock::now();
+    const size_t width = frame_.width;
+    rgb.resize(width * frame_.height * 3);
+    uint8_t* image = rgb.data();
+
+    if(frame_.mode == RenderMode::Distance) {
+        const float pixel_size = (frame_.viewport.right - frame_.viewport.left) / (width - 1);
+        #pragma omp parallel
+        {
+            PerfScope counters(perf_, "colorize", omp_get_thread_num());
+            #pragma omp for nowait
+            for(size_t y = row_begin; y < row_end; ++y) {
+                for(size_t x = 0; x < width; ++x) {
+                    map_distance(frame_.distance[y * width + x], pixel_size, image + y * width * 3 + x * 3);
+                }
+            }
+        }
+    }
+    else {
+        const int max_iteration = frame_.max_iteration;
+        #pragma omp parallel
+        {
+            PerfScope counters(perf_, "colorize", omp_get_thread_num());
+            #pragma omp for nowait
+            for(size_t y = row_begin; y < row_end; ++y) {
+                for(size_t x = 0; x < width; ++x) {
+                    int iteration = frame_.iterations[y * width + x];
+                    map_color((float)iteration/max_iteration, image + y * width * 3 + x * 3);
+                }
+            }
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    frame_.colorize_seconds += std::chrono::duration<double>(end - start).count();
+}
+
+const RgbBuffer& Renderer::colorize() {
+    frame_.colorize_seconds = 0.0;
+    colorize_rows(0, frame_.height, rgb_);
+    return rgb_;
+}
+
+void Renderer::colorize(RgbBuffer& rgb) {
+    frame_.colorize_seconds = 0.0;
+    colorize_rows(0, frame_.height, rgb);
+}
+
+const RgbBuffer& Renderer::render_rgb(const Viewport& viewport, const RenderOptions& options) {
+    render(viewport, options);
+    return colorize();
+}
+
+void Renderer::stream_rgb(const Viewport& viewport, const RenderOptions& options, size_t band_rows,
+    const std::function<void(size_t row_begin, size_t row_end, const uint8_t* rgb)>& sink) {
+    // Whole-frame backends still stream, they just deliver every band once the frame is done
+    if(!backend_->partial_rows()) {
+        render(viewport, options);
+        for(size_t y = 0; y < options.height; y += band_rows) {
+            size_t end = std::min(y + band_rows, options.height);
+            colorize_rows(y, end, rgb_);
+            sink(y, end, rgb_.data() + y * options.width * 3);
+        }
+        return;
+    }
+
+    prepare(viewport, options);
+    Frame total;
+    total.setup_seconds = allocation_seconds_;
+    for(size_t y = 0; y < options.height; y += band_rows) {
+        size_t end = std::min(y + band_rows, options.height);
+        TRACE_ZONE_ID("band", y / band_rows);
+        render_rows(viewport, options, y, end);
+        total.setup_seconds += frame_.setup_seconds;
+        total.coordinate_seconds += frame_.coordinate_seconds;
+        total.compute_seconds += frame_.compute_seconds;
+        total.readback_seconds += frame_.readback_seconds;
+        if(frame_.executed_iterations)
+            total.executed_iterations = total.executed_iterations.value_or(0) + *frame_.executed_iterations;
+        if(frame_.lane_slots)
+            total.lane_slots = total.lane_slots.value_or(0) + *frame_.lane_slots;
+        colorize_rows(y, end, rgb_);
+        sink(y, end, rgb_.data() + y * options.width * 3);
+    }
+    frame_.setup_seconds = total.setup_seconds;
+    frame_.coordinate_seconds = total.coordinate_seconds;
+    frame_.compute_seconds = total.compute_seconds;
+    frame_.readback_seconds = total.readback_seconds;
+    frame_.executed_iterations = total.executed_iterations;
+    frame_.lane_slots = total.lane_slots;
+}
+
+Viewport default_viewport(const FractalConfig& fractal) {
+    Viewport viewport;
+    if(fractal.type == FractalType::Julia) {
+        viewport.left = -1.5;
+        viewport.right = 1.5;
+    }
+    return viewport;
+}
+
+}
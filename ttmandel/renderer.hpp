@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "counting_allocator.hpp"
+#include "fractal.hpp"
+
+namespace ttmandel {
+
+// Region of the complex plane mapped onto the image. Pixel (x, y) samples
+// left + (right - left) * x / (width - 1), so both edges are included.
+struct Viewport {
+    double left = -2.0;
+    double right = 1.0;
+    double bottom = -1.5;
+    double top = 1.5;
+};
+
+enum class RenderMode {
+    EscapeTime,
+    Distance,
+};
+
+// Floating point type the kernels iterate in. Single precision runs out of mantissa around a view width of 1e-5;
+// deeper zooms need double, which only the CPU backend has.
+enum class Precision {
+    Single,
+    Double,
+};
+
+class PerfProfile;
+class EnergyProfile;
+class MemoryProfile;
+struct CostMap;
+
+// Set from any thread to abandon a render. Backends that can poll it do so between rows.
+using CancelToken = std::atomic<bool>;
+
+struct RenderOptions {
+    size_t width = 1024;
+    size_t height = 1024;
+    int max_iteration = 64;
+    RenderMode mode = RenderMode::EscapeTime;
+    FractalConfig fractal;
+    Precision precision = Precision::Single;
+    const CancelToken* cancel = nullptr;
+    // Renders rows [row_offset, row_offset + height) of an image image_height rows tall (0 means height), so bands
+    // rendered separately sample exactly the points of the full image.
+    size_t row_offset = 0;
+    size_t image_height = 0;
+    // When set, hardware counters of every render phase are added to it (CPU backend and Renderer only)
+    PerfProfile* perf = nullptr;
+    // When set, RAPL package and DRAM energy of every render phase is added to it (Renderer only)
+    EnergyProfile* energy = nullptr;
+    // When set, high-water marks of the tracked buffers and of RSS per render phase are recorded in it (Renderer only)
+    MemoryProfile* memory = nullptr;
+    // When set, filled with the iterations, time and worker of every row. Renderer sizes it.
+    CostMap* cost = nullptr;
+};
+
+// Thrown by Renderer when options.cancel was set during a render. The frame contents are unspecified.
+class RenderCancelled : public std::runtime_error {
+public:
+    RenderCancelled() : std::runtime_error("Render cancelled") {}
+};
+
+// Output of a render. Only the plane matching `mode` is filled; the other one is left empty.
+struct Frame {
+    size_t width = 0;
+    size_t height = 0;
+    int max_iteration = 0;
+    RenderMode mode = RenderMode::EscapeTime;
+    Viewport viewport;
+    CountedVector<int32_t, MemoryClass::Iterations> iterations;
+    CountedVector<float, MemoryClass::Distance> distance;
+    // Time spent in the compute region alone, as measured by the backend
+    double compute_seconds = 0.0;
+    // Other phases of the render, in seconds. Backends fill the ones they have, the rest stay 0.
+    // setup: buffer allocation, plus device bring-up and kernel compilation on the first render
+    double setup_seconds = 0.0;
+    // coordinates: host side generation and upload of per-pixel coordinates
+    double coordinate_seconds = 0.0;
+    // readback: device to host copy and conversion to iteration counts
+    double readback_seconds = 0.0;
+    // colorize: set by Renderer::colorize()
+    double colorize_seconds = 0.0;
+    // Iterations executed over all pixels, including the ones of distance mode, which leaves no iteration plane.
+    // Counted by the backend, or by Renderer from the iteration plane of escape time frames.
+    std::optional<uint64_t> executed_iterations;
+    // Lane iterations a vectorized kernel issued, idle lanes included. executed_iterations / lane_slots is the share
+    // of the vector lanes that did useful work.
+    std::optional<uint64_t> lane_slots;
+};
+
+// A device or kernel that turns a viewport into iteration counts or distances.
+class Backend {
+public:
+    virtual ~Backend() = default;
+    virtual std::string name() const = 0;
+
+    // Renders rows [row_begin, row_end) into `frame`, whose planes are already sized for the whole image. Sets
+    // compute_seconds and whichever of the other phase timings apply to this call; they are zeroed beforehand.
+    virtual void render(const Viewport& viewport, const RenderOptions& options,
+        size_t row_begin, size_t row_end, Frame& frame) = 0;
+
+    // Whether render() accepts arbitrary row ranges. Backends that only run whole frames are always called with
+    // [0, height).
+    virtual bool partial_rows() const { return true; }
+
+    // Theoretical GFLOP/s of the hardware the backend renders on at `precision`, 0 when unknown
+    virtual double peak_gflops(Precision /*precision*/) const { return 0.0; }
+
+    // Bytes the backend keeps on the host for a render of `options` besides the frame, such as coordinate staging
+    // and readback buffers. Used to predict the memory a render needs.
+    virtual size_t host_bytes(const RenderOptions& /*options*/) const { return 0; }
+};
+
+// Front door of the library. Owns a backend plus the frame and RGB buffers, which are reused across calls so
+// batch and server users only pay for setup once.
+class Renderer {
+public:
+    explicit Renderer(std::unique_ptr<Backend> backend);
+
+    // Renders a whole frame. The returned reference is valid until the next call.
+    const Frame& render(const Viewport& viewport, const RenderOptions& options);
+
+    // Colorizes the last rendered frame.
+    const RgbBuffer& colorize();
+    // Same, into a caller owned buffer. Lets pipelined users keep one image encoding while the next one renders.
+    void colorize(RgbBuffer& rgb);
+
+    const RgbBuffer& render_rgb(const Viewport& viewport, const RenderOptions& options);
+
+    // Renders the image in bands of `band_rows` rows and hands each colorized band to `sink` as soon as it is
+    // ready. `rgb` points at the first row of the band, with width * 3 bytes per row.
+    void stream_rgb(const Viewport& viewport, const RenderOptions& options, size_t band_rows,
+        const std::function<void(size_t row_begin, size_t row_end, const uint8_t* rgb)>& sink);
+
+    Backend& backend() { return *backend_; }
+    const Frame& frame() const { return frame_; }
+
+private:
+    void prepare(const Viewport& viewport, const RenderOptions& options);
+    void render_rows(const Viewport& viewport, const RenderOptions& options, size_t row_begin, size_t row_end);
+    void colorize_rows(size_t row_begin, size_t row_end, RgbBuffer& rgb);
+
+    std::unique_ptr<Backend> backend_;
+    Frame frame_;
+    RgbBuffer rgb_;
+    double allocation_seconds_ = 0.0;
+    PerfProfile* perf_ = nullptr;
+    EnergyProfile* energy_ = nullptr;
+    MemoryProfile* memory_ = nullptr;
+};
+
+// Default viewport for each fractal. Julia sets are centered on the origin, unlike the Mandelbrot family.
+Viewport default_viewport(const FractalConfig& fractal);
+
+}
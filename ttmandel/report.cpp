@@ -0,0 +1,137 @@
+#include "report.hpp"
+
+#include <iomanip>
+#include <limits>
+
+#include "frontend.hpp"
+#include "scenes.hpp"
+
+namespace ttmandel {
+
+Throughput measure_throughput(const Frame& frame, double peak_gflops) {
+    Throughput throughput;
+    if(frame.compute_seconds <= 0.0)
+        return throughput;
+    throughput.mpixel_per_second = double(frame.width) * frame.height / frame.compute_seconds / 1e6;
+    if(frame.executed_iterations) {
+        throughput.giter_per_second = double(*frame.executed_iterations) / frame.compute_seconds / 1e9;
+        throughput.gflops = throughput.giter_per_second * flops_per_iteration;
+        if(peak_gflops > 0.0)
+            throughput.peak_fraction = throughput.gflops / peak_gflops;
+        if(frame.lane_slots && *frame.lane_slots > 0)
+            throughput.lane_utilization = double(*frame.executed_iterations) / *frame.lane_slots;
+    }
+    return throughput;
+}
+
+void print_throughput(std::ostream& out, const Throughput& throughput) {
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2) << throughput.giter_per_second << " Giter/s, "
+        << throughput.mpixel_per_second << " Mpixel/s, " << throughput.gflops << " GFLOP/s";
+    if(throughput.peak_fraction)
+        out << " (" << std::setprecision(1) << *throughput.peak_fraction * 100.0 << "% of peak)";
+    if(throughput.lane_utilization)
+        out << ", " << std::setprecision(1) << *throughput.lane_utilization * 100.0 << "% lane utilization";
+    out << std::defaultfloat << std::setprecision(precision);
+}
+
+RenderReport make_report(const Frame& frame, const RenderOptions& options, const Backend& backend,
+    const std::string& output_file) {
+    RenderReport report;
+    report.backend = backend.name();
+    report.viewport = frame.viewport;
+    report.options = options;
+    report.output_file = output_file;
+    report.setup_seconds = frame.setup_seconds;
+    report.coordinate_seconds = frame.coordinate_seconds;
+    report.compute_seconds = frame.compute_seconds;
+    report.readback_seconds = frame.readback_seconds;
+    report.colorize_seconds = frame.colorize_seconds;
+    report.pixels = uint64_t(frame.width) * frame.height;
+    report.iterations = frame.executed_iterations;
+    report.checksum = frame_checksum(frame);
+    report.throughput = measure_throughput(frame, backend.peak_gflops(options.precision));
+    return report;
+}
+
+std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for(char c : s) {
+        if(c == '"' || c == '\\')
+            out += '\\';
+        if(uint8_t(c) < 0x20)
+            continue;
+        out += c;
+    }
+    return out + "\"";
+}
+
+void write_json(std::ostream& out, const RenderReport& report) {
+    const std::streamsize precision = out.precision();
+    const RenderOptions& o = report.options;
+    const Viewport& v = report.viewport;
+    out << "{\"backend\": " << json_string(report.backend)
+        << ", \"config\": {\"width\": " << o.width
+        << ", \"height\": " << o.height
+        << ", \"max_iter\": " << o.max_iteration
+        << ", \"mode\": " << json_string(render_mode_name(o.mode))
+        << ", \"fractal\": " << json_string(fractal_type_name(o.fractal.type))
+        << ", \"precision\": " << json_string(precision_name(o.precision))
+        << std::setprecision(std::numeric_limits<float>::max_digits10)
+        << ", \"julia\": [" << o.fractal.julia_real << ", " << o.fractal.julia_imag << "]"
+        << ", \"power\": " << o.fractal.power
+        // Enough digits to tell deep zooms apart
+        << std::setprecision(std::numeric_limits<double>::max_digits10)
+        << ", \"viewport\": [" << v.left << ", " << v.right << ", " << v.bottom << ", " << v.top << "]"
+        << std::setprecision(precision)
+        << ", \"output\": " << json_string(report.output_file) << "}"
+        << ", \"phases\": {\"setup\": " << report.setup_seconds
+        << ", \"coordinates\": " << report.coordinate_seconds
+        << ", \"compute\": " << report.compute_seconds
+        << ", \"readback\": " << report.readback_seconds
+        << ", \"colorize\": " << report.colorize_seconds
+        << ", \"encode\": " << report.encode_seconds << "}"
+        << ", \"wall_seconds\": " << report.wall_seconds
+        << ", \"pixels\": " << report.pixels
+        << ", \"iterations\": ";
+    if(report.iterations)
+        out << *report.iterations;
+    else
+        out << "null";
+    out << ", \"checksum\": \"" << std::hex << std::setw(16) << std::setfill('0') << report.checksum
+        << std::dec << std::setfill(' ') << "\"";
+    const Throughput& t = report.throughput;
+    out << ", \"throughput\": {\"giter_per_second\": " << t.giter_per_second
+        << ", \"mpixel_per_second\": " << t.mpixel_per_second
+        << ", \"gflops\": " << t.gflops
+        << ", \"peak_fraction\": ";
+    if(t.peak_fraction)
+        out << *t.peak_fraction;
+    else
+        out << "null";
+    out << ", \"lane_utilization\": ";
+    if(t.lane_utilization)
+        out << *t.lane_utilization;
+    else
+        out << "null";
+    out << "}";
+    if(report.counters) {
+        out << ", \"counters\": ";
+        report.counters->write_json(out, report.pixels);
+    }
+    if(report.energy) {
+        out << ", \"energy\": ";
+        report.energy->write_json(out, report.pixels);
+    }
+    if(report.memory) {
+        out << ", \"memory\": ";
+        report.memory->write_json(out);
+    }
+    if(report.imbalance) {
+        out << ", \"imbalance\": ";
+        write_json(out, *report.imbalance);
+    }
+    out << "}\n";
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include "cost_map.hpp"
+#include "energy.hpp"
+#include "memory_profile.hpp"
+#include "perf_counters.hpp"
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+// Flops of one Mandelbrot iteration: the two squares and their sum for the escape test, plus the multiply and three
+// adds of the update. Other fractals do a few more or fewer, so GFLOP/s is an effective rate for comparing views.
+constexpr double flops_per_iteration = 7.0;
+
+// Work rates over the compute phase, which unlike wall time can be compared between views of different depth
+struct Throughput {
+    double giter_per_second = 0.0;
+    double mpixel_per_second = 0.0;
+    double gflops = 0.0;
+    // Share of Backend::peak_gflops() at the precision of the render, when the backend knows its peak
+    std::optional<double> peak_fraction;
+    // Share of the issued vector lane iterations that did useful work, for vectorized kernels
+    std::optional<double> lane_utilization;
+};
+
+// Iteration based rates stay 0 when the frame has no iteration count
+Throughput measure_throughput(const Frame& frame, double peak_gflops);
+// "1.23 Giter/s, 4.56 Mpixel/s, 8.61 GFLOP/s (3.1% of peak), 87.5% lane utilization"
+void print_throughput(std::ostream& out, const Throughput& throughput);
+
+// Machine readable summary of one render, printed by --report json for benchmarks and dashboards
+struct RenderReport {
+    std::string backend;
+    Viewport viewport;
+    RenderOptions options;
+    std::string output_file;
+
+    // Phase timings in seconds, see Frame for the render phases
+    double setup_seconds = 0.0;
+    double coordinate_seconds = 0.0;
+    double compute_seconds = 0.0;
+    double readback_seconds = 0.0;
+    double colorize_seconds = 0.0;
+    // Encoding and writing the file, which the encoders stream into
+    double encode_seconds = 0.0;
+    // Wall time of the whole run, including anything the phases do not cover
+    double wall_seconds = 0.0;
+
+    uint64_t pixels = 0;
+    // Iterations executed over all pixels, see Frame::executed_iterations
+    std::optional<uint64_t> iterations;
+    // frame_checksum() of the frame, comparable with the scene catalog
+    uint64_t checksum = 0;
+    Throughput throughput;
+    // Hardware counters per phase, when collected
+    const PerfProfile* counters = nullptr;
+    // RAPL energy per phase, when collected
+    const EnergyProfile* energy = nullptr;
+    // Buffer and RSS high-water marks per phase, when collected
+    const MemoryProfile* memory = nullptr;
+    // Load balance of the render, when a cost map was recorded
+    std::optional<Imbalance> imbalance;
+};
+
+// Fills in the config, the render phases, the pixel and iteration counts of `frame` and its throughput
+RenderReport make_report(const Frame& frame, const RenderOptions& options, const Backend& backend,
+    const std::string& output_file);
+
+void write_json(std::ostream& out, const RenderReport& report);
+
+// Quotes `s` for JSON output, escaping quotes and backslashes and dropping control characters
+std::string json_string(const std::string& s);
+
+}
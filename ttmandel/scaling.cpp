@@ -0,0 +1,124 @@
+#include "scaling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "bench.hpp"
+
+namespace ttmandel {
+
+namespace {
+
+struct Point {
+    const char* kind;
+    size_t threads;
+    size_t size;
+    SampleStats stats{};
+    uint64_t iterations = 0;
+    double speedup = 0.0;
+    double efficiency = 0.0;
+    // NaN for a single thread, where it is undefined
+    double karp_flatt = 0.0;
+};
+
+Point measure(const char* kind, size_t threads, size_t size, const ScalingOptions& options) {
+    CpuTuning tuning = options.tuning;
+    tuning.threads = int(threads);
+    Renderer renderer(std::make_unique<CpuBackend>(tuning));
+    RenderOptions render = options.render;
+    render.width = size;
+    render.height = size;
+    Point point{kind, threads, size};
+    std::vector<double> seconds;
+    for(int i = 0; i < options.warmup + options.repetitions; ++i) {
+        const Frame& frame = renderer.render(options.viewport, render);
+        if(i < options.warmup)
+            continue;
+        seconds.push_back(frame.compute_seconds);
+        point.iterations = frame.executed_iterations.value_or(0);
+    }
+    point.stats = summarize(seconds);
+    return point;
+}
+
+// Speedup relative to one thread. Weak scaling compares iteration throughput, since a larger image of the same
+// view does not do exactly proportionally more work.
+void derive(Point& point, const Point& single) {
+    const double n = double(point.threads);
+    if(point.kind[0] == 's')
+        point.speedup = single.stats.median / point.stats.median;
+    else
+        point.speedup = (point.iterations / point.stats.median) / (single.iterations / single.stats.median);
+    point.efficiency = point.speedup / n;
+    // Experimentally determined serial fraction: stays flat when overhead is serial code, grows when it is
+    // parallel overhead such as scheduling or memory bandwidth
+    point.karp_flatt = point.threads > 1 ? (1.0 / point.speedup - 1.0 / n) / (1.0 - 1.0 / n) : NAN;
+}
+
+}
+
+int run_scaling(const ScalingOptions& options) {
+    std::vector<size_t> threads = options.threads;
+    const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    if(threads.empty()) {
+        for(size_t n = 1; n < hardware; n *= 2)
+            threads.push_back(n);
+        threads.push_back(hardware);
+    }
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+    if(threads.front() == 0) {
+        std::cerr << "Thread counts must be positive" << std::endl;
+        return 1;
+    }
+    if(threads.front() != 1)
+        threads.insert(threads.begin(), 1);
+
+    const HostInfo host = host_info();
+    std::cout << "Host: " << host.cpu_model << ", " << host.cores << " threads, governor " << host.governor
+              << std::endl;
+
+    std::vector<Point> points;
+    for(const char* kind : {"strong", "weak"}) {
+        const size_t first = points.size();
+        for(size_t n : threads) {
+            // Weak scaling keeps the pixels per thread constant
+            size_t size = kind[0] == 's' ? options.size : size_t(std::lround(options.size * std::sqrt(double(n))));
+            points.push_back(measure(kind, n, size, options));
+            derive(points.back(), points[first]);
+
+            const Point& p = points.back();
+            std::cout << std::setw(6) << kind << " " << std::setw(3) << n << " threads, " << size << "x" << size
+                      << ": " << std::fixed << std::setprecision(6) << p.stats.median << " s, speedup "
+                      << std::setprecision(2) << p.speedup << ", efficiency " << std::setprecision(1)
+                      << p.efficiency * 100.0 << "%";
+            if(n > 1)
+                std::cout << ", serial fraction " << std::setprecision(4) << p.karp_flatt;
+            std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+        }
+    }
+
+    std::ofstream out(options.output_file);
+    out << "kind,threads,size,median,mad,ci_low,ci_high,kept,iterations,speedup,efficiency,karp_flatt,"
+           "cpu_model,cores,governor\n";
+    for(const Point& p : points) {
+        out << p.kind << ',' << p.threads << ',' << p.size << ',' << p.stats.median << ',' << p.stats.mad << ','
+            << p.stats.ci_low << ',' << p.stats.ci_high << ',' << p.stats.kept << ',' << p.iterations << ','
+            << p.speedup << ',' << p.efficiency << ',';
+        if(p.threads > 1)
+            out << p.karp_flatt;
+        out << ",\"" << host.cpu_model << "\"," << host.cores << ',' << host.governor << '\n';
+    }
+    if(!out) {
+        std::cerr << "Failed to write " << options.output_file << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+}
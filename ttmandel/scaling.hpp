@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cpu_backend.hpp"
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct ScalingOptions {
+    // Side of the image for strong scaling, and of the single thread image for weak scaling
+    size_t size = 2048;
+    // Thread counts to sweep, powers of two up to every hardware thread when empty
+    std::vector<size_t> threads;
+    // Tuning of every point, except for the thread count
+    CpuTuning tuning;
+    int warmup = 2;
+    int repetitions = 10;
+    std::string output_file = "scaling.csv";
+    RenderOptions render;
+    Viewport viewport;
+};
+
+// Renders with the CPU backend at every thread count, once at a fixed size (strong scaling) and once with the pixel
+// count proportional to the threads (weak scaling). Prints and writes the median times with speedup, parallel
+// efficiency and the Karp-Flatt serial fraction. Returns the process exit code.
+int run_scaling(const ScalingOptions& options);
+
+}
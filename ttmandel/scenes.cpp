@@ -0,0 +1,108 @@
+#include "scenes.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace ttmandel {
+
+namespace {
+
+Scene make_scene(const char* name, const char* description, Viewport viewport, size_t size, int max_iteration,
+    Precision precision, uint64_t checksum) {
+    Scene scene{name, description, viewport, {}, checksum};
+    scene.options.width = size;
+    scene.options.height = size;
+    scene.options.max_iteration = max_iteration;
+    scene.options.precision = precision;
+    return scene;
+}
+
+// Square viewport of half width `radius` around (x, y)
+Viewport around(double x, double y, double radius) {
+    return {x - radius, x + radius, y - radius, y + radius};
+}
+
+}
+
+const std::vector<Scene>& scene_catalog() {
+    static const std::vector<Scene> catalog = {
+        make_scene("default", "The default view: a mix of interior, boundary and fast exterior",
+            Viewport{}, 1024, 64, Precision::Single,
+            0x515683aa2d14513full),
+        make_scene("exterior", "No interior points, most pixels escape in a few iterations",
+            Viewport{0.5, 2.0, -0.75, 0.75}, 1024, 256, Precision::Single,
+            0x582843d30a64a945ull),
+        make_scene("interior", "Inside the main cardioid, every pixel runs to max_iter",
+            around(-0.2, 0.0, 0.25), 1024, 256, Precision::Single,
+            0xd88f5efddfa22325ull),
+        make_scene("seahorse-valley", "Boundary dominated: iteration counts vary from pixel to pixel",
+            around(-0.7463, 0.1102, 0.005), 1024, 512, Precision::Single,
+            0x329fef851e533b76ull),
+        make_scene("deep-zoom", "A 1e-10 wide view that single precision cannot resolve",
+            around(-0.743643887037151, 0.131825904205330, 5e-11), 512, 2048, Precision::Double,
+            0xf9fb02131cb0575bull),
+        make_scene("minibrot", "A period 3 minibrot needing a high max_iter to separate from its halo",
+            around(-1.7548776662, 0.0, 0.02), 512, 4096, Precision::Single,
+            0xa617a8fc4fbf9305ull),
+    };
+    return catalog;
+}
+
+const Scene* find_scene(std::string_view name) {
+    for(const Scene& scene : scene_catalog()) {
+        if(scene.name == name)
+            return &scene;
+    }
+    return nullptr;
+}
+
+void apply_scene(const Scene& scene, RenderOptions& options) {
+    options.width = scene.options.width;
+    options.height = scene.options.height;
+    options.max_iteration = scene.options.max_iteration;
+    options.mode = scene.options.mode;
+    options.fractal = scene.options.fractal;
+    options.precision = scene.options.precision;
+}
+
+std::vector<const Scene*> parse_scenes(const std::string& list) {
+    std::vector<const Scene*> scenes;
+    size_t pos = 0;
+    while(pos <= list.size()) {
+        size_t comma = std::min(list.find(',', pos), list.size());
+        const std::string name = list.substr(pos, comma - pos);
+        pos = comma + 1;
+        if(name == "all") {
+            for(const Scene& scene : scene_catalog())
+                scenes.push_back(&scene);
+            continue;
+        }
+        const Scene* scene = find_scene(name);
+        if(!scene) {
+            std::string known = "all";
+            for(const Scene& s : scene_catalog())
+                known += ", " + s.name;
+            throw std::runtime_error("Unknown scene " + name + ", expected one of " + known);
+        }
+        scenes.push_back(scene);
+    }
+    return scenes;
+}
+
+uint64_t frame_checksum(const Frame& frame) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](const void* data, size_t bytes) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for(size_t i = 0; i < bytes; ++i) {
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    if(frame.mode == RenderMode::Distance)
+        mix(frame.distance.data(), frame.distance.size() * sizeof(float));
+    else
+        mix(frame.iterations.data(), frame.iterations.size() * sizeof(int32_t));
+    return hash;
+}
+
+}
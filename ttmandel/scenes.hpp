@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+// A fixed benchmark workload. Views differ wildly in cost and in how it is spread, so kernels and schedulers are
+// judged on the whole catalog rather than on the default view alone.
+struct Scene {
+    std::string name;
+    std::string description;
+    Viewport viewport;
+    // width, height, max_iteration, fractal and precision of the scene, in escape time mode
+    RenderOptions options;
+    // frame_checksum() of the scene rendered by the CPU backend, built without FMA contraction (the default flags)
+    uint64_t checksum;
+};
+
+const std::vector<Scene>& scene_catalog();
+// nullptr for unknown names
+const Scene* find_scene(std::string_view name);
+// Copies the size and render settings of `scene` into `options`, leaving hooks such as cancel and perf alone
+void apply_scene(const Scene& scene, RenderOptions& options);
+// Resolves a comma separated list of scene names, "all" meaning the whole catalog. Throws on unknown names.
+std::vector<const Scene*> parse_scenes(const std::string& list);
+
+// FNV-1a over the iteration plane (escape time) or the bit patterns of the distance plane
+uint64_t frame_checksum(const Frame& frame);
+
+}
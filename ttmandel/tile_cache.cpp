@@ -0,0 +1,52 @@
+#include "tile_cache.hpp"
+
+namespace ttmandel {
+
+Png TileCache::get(const TileKey& key) {
+    std::lock_guard lock(mutex);
+    auto it = index.find(key);
+    if(it == index.end()) {
+        counters.misses++;
+        return nullptr;
+    }
+    counters.hits++;
+    Entry& entry = *it->second;
+    if(entry.prefetched) {
+        // Only the first request counts, later ones would have hit the cache anyway
+        counters.prefetch_hits++;
+        entry.prefetched = false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    return entry.png;
+}
+
+void TileCache::put(const TileKey& key, Png png, bool prefetched) {
+    if(!png || png->size() > max_bytes)
+        return;
+    std::lock_guard lock(mutex);
+    if(index.contains(key))
+        return;
+    if(prefetched)
+        counters.prefetched++;
+    counters.bytes += png->size();
+    lru.push_front({key, std::move(png), prefetched});
+    index[key] = lru.begin();
+    while(counters.bytes > max_bytes) {
+        counters.bytes -= lru.back().png->size();
+        index.erase(lru.back().key);
+        lru.pop_back();
+    }
+    counters.tiles = lru.size();
+}
+
+bool TileCache::contains(const TileKey& key) const {
+    std::lock_guard lock(mutex);
+    return index.contains(key);
+}
+
+TileCache::Stats TileCache::stats() const {
+    std::lock_guard lock(mutex);
+    return counters;
+}
+
+}
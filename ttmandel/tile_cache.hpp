@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "tile_queue.hpp"
+
+namespace ttmandel {
+
+// In-memory LRU of encoded tiles, bounded by their total size. Tracks which tiles were rendered speculatively so
+// the prefetch hit rate can be reported.
+class TileCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // Tiles that entered the cache through prefetch, and how many of those were requested afterwards
+        uint64_t prefetched = 0;
+        uint64_t prefetch_hits = 0;
+        size_t tiles = 0;
+        size_t bytes = 0;
+    };
+
+    explicit TileCache(size_t max_bytes) : max_bytes(max_bytes) {}
+
+    // Returns the tile and marks it most recently used, or nullptr if it is not cached
+    Png get(const TileKey& key);
+    void put(const TileKey& key, Png png, bool prefetched);
+    // Lookup without touching the LRU order or the statistics
+    bool contains(const TileKey& key) const;
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        TileKey key;
+        Png png;
+        bool prefetched;
+    };
+
+    mutable std::mutex mutex;
+    const size_t max_bytes;
+    std::list<Entry> lru;
+    std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> index;
+    Stats counters;
+};
+
+}
@@ -0,0 +1,157 @@
+#include "tile_queue.hpp"
+
+#include <algorithm>
+
+namespace ttmandel {
+
+std::shared_ptr<TileTicket> TileQueue::request(const TileKey& key, const std::string& client, uint64_t generation) {
+    std::lock_guard lock(mutex);
+    counters.requests++;
+
+    auto ticket = std::make_shared<TileTicket>();
+    ticket->client = client;
+    ticket->generation = generation;
+
+    if(!client.empty()) {
+        uint64_t& latest = client_generation[client];
+        if(generation < latest) {
+            // Arrived after the client already moved on
+            ticket->withdrawn = true;
+            ticket->superseded = true;
+            counters.superseded++;
+            return ticket;
+        }
+
+        std::vector<std::weak_ptr<TileTicket>>& tickets = client_tickets[client];
+        if(generation > latest) {
+            latest = generation;
+            for(const auto& weak : tickets) {
+                std::shared_ptr<TileTicket> old = weak.lock();
+                if(old && !old->withdrawn && old->generation < generation) {
+                    release(*old);
+                    old->superseded = true;
+                    counters.superseded++;
+                }
+            }
+        }
+        std::erase_if(tickets, [](const std::weak_ptr<TileTicket>& weak) {
+            std::shared_ptr<TileTicket> t = weak.lock();
+            return !t || t->withdrawn;
+        });
+        tickets.push_back(ticket);
+    }
+
+    std::shared_ptr<TileJob>& job = pending[key];
+    if(!job) {
+        job = std::make_shared<TileJob>();
+        job->key = key;
+    } else if(!job->speculative) {
+        counters.coalesced++;
+    }
+    job->speculative = false;
+    job->priority = ++sequence;
+    job->waiters++;
+    if(!job->running) {
+        heap.push({false, job->priority, job});
+        cv.notify_one();
+    }
+    ticket->job = job;
+
+    if(running && running->speculative) {
+        drop(running);
+        counters.prefetch_preempted++;
+    }
+    return ticket;
+}
+
+bool TileQueue::prefetch(const TileKey& key) {
+    std::lock_guard lock(mutex);
+    if(max_speculative == 0 || pending.contains(key))
+        return false;
+
+    auto job = std::make_shared<TileJob>();
+    job->key = key;
+    job->speculative = true;
+    job->priority = ++sequence;
+    pending[key] = job;
+    heap.push({true, job->priority, job});
+    counters.prefetch_queued++;
+
+    std::erase_if(speculative, [](const std::shared_ptr<TileJob>& j) {
+        return !j->speculative || j->running || j->finished;
+    });
+    speculative.push_back(job);
+    while(speculative.size() > max_speculative) {
+        drop(speculative.front());
+        speculative.pop_front();
+    }
+    cv.notify_one();
+    return true;
+}
+
+// Cancels a job nobody waits for anymore. Requests arriving later start a fresh job.
+void TileQueue::drop(const std::shared_ptr<TileJob>& job) {
+    job->cancel = true;
+    auto it = pending.find(job->key);
+    if(it != pending.end() && it->second == job)
+        pending.erase(it);
+    // A queued job will never reach the render thread now (its heap entry is skipped), so settle it here. A running
+    // one is settled by finish() once the renderer notices the cancel token.
+    if(!job->running && !job->finished) {
+        job->finished = true;
+        job->promise.set_value(nullptr);
+    }
+}
+
+void TileQueue::release(TileTicket& ticket) {
+    if(ticket.withdrawn)
+        return;
+    ticket.withdrawn = true;
+
+    const std::shared_ptr<TileJob>& job = ticket.job;
+    if(!job || --job->waiters > 0 || job->finished)
+        return;
+
+    drop(job);
+    counters.cancelled++;
+}
+
+void TileQueue::withdraw(const std::shared_ptr<TileTicket>& ticket) {
+    std::lock_guard lock(mutex);
+    release(*ticket);
+}
+
+std::shared_ptr<TileJob> TileQueue::next() {
+    std::unique_lock lock(mutex);
+    for(;;) {
+        cv.wait(lock, [this] { return !heap.empty(); });
+        Entry entry = heap.top();
+        heap.pop();
+        const std::shared_ptr<TileJob>& job = entry.job;
+        if(job->running || job->finished || entry.priority != job->priority)
+            continue;
+        job->running = true;
+        running = job;
+        return job;
+    }
+}
+
+void TileQueue::finish(const std::shared_ptr<TileJob>& job, Png png) {
+    std::lock_guard lock(mutex);
+    if(running == job)
+        running = nullptr;
+    auto it = pending.find(job->key);
+    if(it != pending.end() && it->second == job)
+        pending.erase(it);
+    if(!job->finished) {
+        job->finished = true;
+        job->promise.set_value(std::move(png));
+    }
+}
+
+TileQueue::Stats TileQueue::stats() const {
+    std::lock_guard lock(mutex);
+    return counters;
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct TileKey {
+    int z;
+    int x;
+    int y;
+
+    bool operator==(const TileKey&) const = default;
+};
+
+struct TileKeyHash {
+    size_t operator()(const TileKey& key) const {
+        return std::hash<uint64_t>()((uint64_t(key.z) << 58) ^ (uint64_t(key.x) << 29) ^ uint64_t(key.y));
+    }
+};
+
+using Png = std::shared_ptr<const std::vector<uint8_t>>;
+
+// One render of one tile, shared by every request for that tile while it is queued or running.
+struct TileJob {
+    TileKey key;
+    // Sequence number of the newest request for this tile. Higher numbers render first.
+    uint64_t priority = 0;
+    size_t waiters = 0;
+    bool running = false;
+    bool finished = false;
+    // Queued by prefetch() and not requested by anyone yet. Cleared when a request joins the job.
+    std::atomic<bool> speculative{false};
+    CancelToken cancel{false};
+    std::promise<Png> promise;
+    std::shared_future<Png> result = promise.get_future().share();
+};
+
+// One request's interest in a tile.
+struct TileTicket {
+    std::shared_ptr<TileJob> job;
+    std::string client;
+    uint64_t generation = 0;
+    // Set once the ticket no longer counts towards its job, either withdrawn or superseded
+    bool withdrawn = false;
+    std::atomic<bool> superseded{false};
+};
+
+// Priority queue of tile renders for the tile server.
+//
+// * Newest first: a map viewer's latest viewport is what the user is looking at, older requests are likely
+//   off-screen by the time they would render.
+// * Coalescing: requests for a tile that is already queued or running join that render instead of adding one.
+// * Cancellation: a job whose last waiting request is withdrawn (client disconnected) or superseded (same client
+//   moved on to a newer generation) is dropped from the queue, or has its cancel token set if it is running.
+// * Prefetch: speculative jobs only run when no request is queued, and a running one is cancelled as soon as a
+//   request for another tile arrives.
+class TileQueue {
+public:
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t coalesced = 0;
+        uint64_t cancelled = 0;
+        uint64_t superseded = 0;
+        uint64_t prefetch_queued = 0;
+        uint64_t prefetch_preempted = 0;
+    };
+
+    // At most `max_speculative` prefetch jobs are kept queued; older ones are dropped first. 0 disables prefetch.
+    explicit TileQueue(size_t max_speculative = 0) : max_speculative(max_speculative) {}
+
+    // Registers a request for `key`. Requests with a non-empty `client` take part in supersession: once a client
+    // asks for generation N, its pending requests with a lower generation are superseded.
+    std::shared_ptr<TileTicket> request(const TileKey& key, const std::string& client = "", uint64_t generation = 0);
+
+    // Drops a request, e.g. because its connection closed. Cancels the render if nobody else waits for it.
+    void withdraw(const std::shared_ptr<TileTicket>& ticket);
+
+    // Queues a speculative render of `key` unless it is already queued or running. Returns whether it was queued.
+    bool prefetch(const TileKey& key);
+
+    // Blocks until a job is available and marks it running. Only for the render thread.
+    std::shared_ptr<TileJob> next();
+
+    // Publishes the result of a running job (nullptr on failure or cancellation) and retires it.
+    void finish(const std::shared_ptr<TileJob>& job, Png png);
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        bool speculative;
+        uint64_t priority;
+        std::shared_ptr<TileJob> job;
+        bool operator<(const Entry& other) const {
+            if(speculative != other.speculative)
+                return speculative;
+            return priority < other.priority;
+        }
+    };
+
+    void release(TileTicket& ticket);
+    void drop(const std::shared_ptr<TileJob>& job);
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    uint64_t sequence = 0;
+    // Entries go stale when their job is bumped to a higher priority, starts running or is cancelled; they are
+    // skipped when popped instead of being searched for and erased.
+    std::priority_queue<Entry> heap;
+    std::unordered_map<TileKey, std::shared_ptr<TileJob>, TileKeyHash> pending;
+    std::shared_ptr<TileJob> running;
+    // Prefetch jobs in the order they were queued
+    std::deque<std::shared_ptr<TileJob>> speculative;
+    const size_t max_speculative;
+    std::unordered_map<std::string, uint64_t> client_generation;
+    std::unordered_map<std::string, std::vector<std::weak_ptr<TileTicket>>> client_tickets;
+    Stats counters;
+};
+
+}
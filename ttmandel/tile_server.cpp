@@ -0,0 +1,392 @@
+#include "tile_server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net.hpp"
+#include "tile_cache.hpp"
+#include "tile_queue.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+namespace ttmandel {
+
+Viewport tile_viewport(const Viewport& world, int zoom, int x, int y, size_t tile_size) {
+    const double tiles = double(1ull << zoom);
+    const double tile_w = (world.right - world.left) / tiles;
+    const double tile_h = (world.top - world.bottom) / tiles;
+    const double x0 = world.left + tile_w * x;
+    const double y0 = world.top - tile_h * y;
+    const double pixel_w = tile_w / tile_size;
+    const double pixel_h = tile_h / tile_size;
+    return {x0 + 0.5 * pixel_w, x0 + tile_w - 0.5 * pixel_w, y0 - 0.5 * pixel_h, y0 - tile_h + 0.5 * pixel_h};
+}
+
+namespace {
+
+// Keeps the most recent tile latencies around for percentile reporting
+class LatencyStats {
+public:
+    void add(double ms) {
+        std::lock_guard lock(mutex);
+        if(samples.size() < max_samples) {
+            samples.push_back(ms);
+        } else {
+            samples[count % max_samples] = ms;
+        }
+        count++;
+    }
+
+    void write_json(std::ostream& out) const {
+        std::vector<double> sorted;
+        size_t total;
+        {
+            std::lock_guard lock(mutex);
+            sorted = samples;
+            total = count;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&](double p) {
+            return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+        };
+        out << "\"tiles\": " << total
+            << ", \"p50_ms\": " << percentile(0.50)
+            << ", \"p99_ms\": " << percentile(0.99)
+            << ", \"max_ms\": " << (sorted.empty() ? 0.0 : sorted.back());
+    }
+
+private:
+    static constexpr size_t max_samples = 4096;
+    mutable std::mutex mutex;
+    std::vector<double> samples;
+    size_t count = 0;
+};
+
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    // Query parameters of tile requests, see TileQueue
+    std::string client;
+    uint64_t generation = 0;
+    std::string if_none_match;
+    bool keep_alive = true;
+};
+
+// Whether the peer closed or reset the connection, without consuming any pipelined request bytes
+bool peer_closed(int fd) {
+    pollfd p = {fd, POLLRDHUP, 0};
+    return poll(&p, 1, 0) > 0 && (p.revents & (POLLRDHUP | POLLHUP | POLLERR));
+}
+
+// Reads one request head from the connection. `buffer` carries bytes past the end of the previous request
+// (pipelining). Returns false when the peer goes away or sends something that is not HTTP.
+bool read_request(int fd, std::string& buffer, HttpRequest& request) {
+    constexpr size_t max_head = 16 * 1024;
+    size_t end;
+    while((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if(buffer.size() > max_head)
+            return false;
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if(n <= 0)
+            return false;
+        buffer.append(chunk, n);
+    }
+    std::istringstream head(buffer.substr(0, end));
+    buffer.erase(0, end + 4);
+
+    std::string line, version;
+    if(!std::getline(head, line))
+        return false;
+    std::istringstream request_line(line);
+    if(!(request_line >> request.method >> request.path >> version))
+        return false;
+    request.keep_alive = version == "HTTP/1.1";
+    request.if_none_match.clear();
+    request.client.clear();
+    request.generation = 0;
+
+    size_t query = request.path.find('?');
+    if(query != std::string::npos) {
+        std::istringstream params(request.path.substr(query + 1));
+        request.path.erase(query);
+        std::string param;
+        while(std::getline(params, param, '&')) {
+            if(param.starts_with("client="))
+                request.client = param.substr(7);
+            else if(param.starts_with("gen="))
+                request.generation = std::strtoull(param.c_str() + 4, nullptr, 10);
+        }
+    }
+
+    while(std::getline(head, line)) {
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+        size_t colon = line.find(':');
+        if(colon == std::string::npos)
+            continue;
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        size_t value_start = line.find_first_not_of(' ', colon + 1);
+        std::string value = value_start == std::string::npos ? "" : line.substr(value_start);
+        if(name == "connection") {
+            std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+            if(value == "close")
+                request.keep_alive = false;
+            else if(value == "keep-alive")
+                request.keep_alive = true;
+        } else if(name == "if-none-match") {
+            request.if_none_match = value;
+        }
+    }
+    return true;
+}
+
+std::optional<TileKey> parse_tile_path(std::string_view path) {
+    TileKey key;
+    char suffix[8] = {};
+    if(std::sscanf(std::string(path).c_str(), "/%d/%d/%d.%4s", &key.z, &key.x, &key.y, suffix) != 4)
+        return std::nullopt;
+    if(std::string_view(suffix) != "png" || key.z < 0 || key.z > 30)
+        return std::nullopt;
+    const int tiles = 1 << key.z;
+    if(key.x < 0 || key.y < 0 || key.x >= tiles || key.y >= tiles)
+        return std::nullopt;
+    return key;
+}
+
+class TileServer {
+public:
+    TileServer(Renderer& renderer, const TileServerOptions& options)
+        : renderer(renderer), options(options), world(default_viewport(options.render.fractal)),
+          queue(options.prefetch), cache(options.cache_bytes) {
+        tile_options = options.render;
+        tile_options.width = options.tile_size;
+        tile_options.height = options.tile_size;
+
+        // Tiles are immutable for a given configuration, so the ETag only has to identify the configuration
+        std::ostringstream config;
+        const FractalConfig& f = options.render.fractal;
+        config << std::setprecision(std::numeric_limits<float>::max_digits10) << int(f.type) << ',' << f.julia_real
+               << ',' << f.julia_imag << ',' << f.power << ',' << int(options.render.mode) << ','
+               << int(options.render.precision) << ',' << options.render.max_iteration << ',' << options.tile_size;
+        uint64_t hash = 1469598103934665603ull;
+        for(char c : config.str())
+            hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+        std::ostringstream tag;
+        tag << std::hex << hash;
+        etag_prefix = tag.str();
+    }
+
+    int run() {
+        int listener = open_listener(options.address);
+        if(listener < 0)
+            return 1;
+        std::cout << "Serving " << options.tile_size << "x" << options.tile_size << " tiles on "
+                  << options.address << std::endl;
+
+        std::thread(&TileServer::render_loop, this).detach();
+        for(;;) {
+            int fd = accept(listener, nullptr, nullptr);
+            if(fd < 0) {
+                if(errno == EINTR)
+                    continue;
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::thread(&TileServer::serve_connection, this, fd).detach();
+        }
+    }
+
+private:
+    // The only thread touching the renderer. Every tile uses all of the renderer's threads, which keeps the
+    // latency of each individual tile as low as possible.
+    void render_loop() {
+        for(;;) {
+            std::shared_ptr<TileJob> job = queue.next();
+            RenderOptions job_options = tile_options;
+            job_options.cancel = &job->cancel;
+            try {
+                TRACE_ZONE("tile");
+                const TileKey& key = job->key;
+                const RgbBuffer& rgb =
+                    renderer.render_rgb(tile_viewport(world, key.z, key.x, key.y, options.tile_size), job_options);
+                auto png = std::make_shared<std::vector<uint8_t>>();
+                const int size = options.tile_size;
+                {
+                    TRACE_ZONE("encode");
+                    if(!encode_png(size, size, rgb.data(), size * 3, *png))
+                        png = nullptr;
+                }
+                // Cached before the job retires so a request arriving in between finds it
+                cache.put(key, png, job->speculative);
+                queue.finish(job, png);
+            } catch(const RenderCancelled&) {
+                queue.finish(job, nullptr);
+            } catch(const std::exception& e) {
+                std::cerr << "Failed to render tile: " << e.what() << std::endl;
+                queue.finish(job, nullptr);
+            }
+        }
+    }
+
+    // Queues the tiles a viewer is likely to ask for next: the children of `key` and, rendered first, its neighbours
+    void prefetch_around(const TileKey& key) {
+        if(options.prefetch == 0)
+            return;
+        const int tiles = 1 << key.z;
+        auto consider = [&](int z, int x, int y) {
+            const TileKey k{z, x, y};
+            if(!cache.contains(k))
+                queue.prefetch(k);
+        };
+        if(key.z < 30) {
+            for(int i = 0; i < 4; ++i)
+                consider(key.z + 1, key.x * 2 + i % 2, key.y * 2 + i / 2);
+        }
+        for(int dy = -1; dy <= 1; ++dy) {
+            for(int dx = -1; dx <= 1; ++dx) {
+                const int x = key.x + dx;
+                const int y = key.y + dy;
+                if((dx != 0 || dy != 0) && x >= 0 && y >= 0 && x < tiles && y < tiles)
+                    consider(key.z, x, y);
+            }
+        }
+    }
+
+    std::string stats_json() const {
+        const TileQueue::Stats q = queue.stats();
+        const TileCache::Stats c = cache.stats();
+        std::ostringstream out;
+        out << "{";
+        stats.write_json(out);
+        out << ", \"requests\": " << q.requests
+            << ", \"coalesced\": " << q.coalesced
+            << ", \"cancelled\": " << q.cancelled
+            << ", \"superseded\": " << q.superseded
+            << ", \"cache_hits\": " << c.hits
+            << ", \"cache_misses\": " << c.misses
+            << ", \"cache_tiles\": " << c.tiles
+            << ", \"cache_bytes\": " << c.bytes
+            << ", \"prefetch_queued\": " << q.prefetch_queued
+            << ", \"prefetch_preempted\": " << q.prefetch_preempted
+            << ", \"prefetched\": " << c.prefetched
+            << ", \"prefetch_hits\": " << c.prefetch_hits
+            << ", \"prefetch_hit_rate\": " << (c.prefetched ? double(c.prefetch_hits) / c.prefetched : 0.0)
+            << "}\n";
+        return out.str();
+    }
+
+    // Waits for the ticket's tile while watching the connection. Returns false if the peer went away first.
+    bool wait(int fd, const TileTicket& ticket) {
+        while(ticket.job->result.wait_for(std::chrono::milliseconds(20)) != std::future_status::ready) {
+            if(ticket.superseded)
+                return true;
+            if(peer_closed(fd))
+                return false;
+        }
+        return true;
+    }
+
+    void serve_connection(int fd) {
+        std::string buffer;
+        HttpRequest request;
+        while(read_request(fd, buffer, request)) {
+            if(!handle(fd, request) || !request.keep_alive)
+                break;
+        }
+        close(fd);
+    }
+
+    bool respond(int fd, const HttpRequest& request, int status, std::string_view reason,
+        std::string_view headers, const void* body, size_t size) {
+        std::ostringstream head;
+        head << "HTTP/1.1 " << status << ' ' << reason << "\r\n"
+             << "Content-Length: " << size << "\r\n"
+             << (request.keep_alive ? "" : "Connection: close\r\n")
+             << headers << "\r\n";
+        const std::string h = head.str();
+        if(!send_all(fd, h.data(), h.size()))
+            return false;
+        return request.method == "HEAD" || size == 0 || send_all(fd, body, size);
+    }
+
+    bool handle(int fd, const HttpRequest& request) {
+        auto start = std::chrono::steady_clock::now();
+        if(request.method != "GET" && request.method != "HEAD")
+            return respond(fd, request, 405, "Method Not Allowed", "Allow: GET, HEAD\r\n", nullptr, 0);
+
+        if(request.path == "/stats") {
+            const std::string body = stats_json();
+            return respond(fd, request, 200, "OK", "Content-Type: application/json\r\nCache-Control: no-store\r\n",
+                body.data(), body.size());
+        }
+
+        std::optional<TileKey> key = parse_tile_path(request.path);
+        if(!key)
+            return respond(fd, request, 404, "Not Found", "", nullptr, 0);
+
+        const std::string etag = "\"" + etag_prefix + "-" + std::to_string(key->z) + "-" + std::to_string(key->x)
+            + "-" + std::to_string(key->y) + "\"";
+        const std::string cache_headers = "ETag: " + etag + "\r\nCache-Control: public, max-age="
+            + std::to_string(options.max_age) + ", immutable\r\n";
+        if(request.if_none_match == etag)
+            return respond(fd, request, 304, "Not Modified", cache_headers, nullptr, 0);
+
+        Png png = cache.get(*key);
+        if(!png) {
+            std::shared_ptr<TileTicket> ticket = queue.request(*key, request.client, request.generation);
+            if(!ticket->superseded && !wait(fd, *ticket)) {
+                queue.withdraw(ticket);
+                return false;
+            }
+            if(ticket->superseded)
+                return respond(fd, request, 503, "Service Unavailable", "Cache-Control: no-store\r\n", nullptr, 0);
+            png = ticket->job->result.get();
+            if(!png)
+                return respond(fd, request, 500, "Internal Server Error", "", nullptr, 0);
+        }
+
+        bool ok = respond(fd, request, 200, "OK", "Content-Type: image/png\r\n" + cache_headers,
+            png->data(), png->size());
+        prefetch_around(*key);
+        stats.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return ok;
+    }
+
+    Renderer& renderer;
+    const TileServerOptions options;
+    const Viewport world;
+    RenderOptions tile_options;
+    std::string etag_prefix;
+    TileQueue queue;
+    TileCache cache;
+    LatencyStats stats;
+};
+
+}
+
+int run_tile_server(Renderer& renderer, const TileServerOptions& options) {
+    TileServer server(renderer, options);
+    return server.run();
+}
+
+}
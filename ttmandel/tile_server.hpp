@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#include "renderer.hpp"
+
+namespace ttmandel {
+
+struct TileServerOptions {
+    // "host:port" for TCP or "unix:/path/to/socket" for a unix domain socket
+    std::string address = "127.0.0.1:8080";
+    // Fractal, mode and max_iteration of every tile. width and height are replaced by tile_size.
+    RenderOptions render;
+    size_t tile_size = 256;
+    // Cache-Control max-age of tile responses, in seconds. Tiles never change for a given server configuration.
+    int max_age = 86400;
+    // Speculative renders kept queued for idle time: the neighbours and children of recently requested tiles.
+    // 0 disables prefetch.
+    size_t prefetch = 32;
+    // Size limit of the in-memory cache of rendered tiles
+    size_t cache_bytes = 64 << 20;
+};
+
+// Viewport of XYZ tile (zoom, x, y) when zoom level 0 is a single tile covering `world`. y grows downwards, as in
+// every slippy map, so the returned viewport has bottom > top and row 0 of the tile is its top edge. Pixels sample
+// their centers so neighbouring tiles never repeat an edge.
+Viewport tile_viewport(const Viewport& world, int zoom, int x, int y, size_t tile_size);
+
+// Serves /z/x/y.png tiles over HTTP/1.1 until the process is killed. Also answers /stats with tile latency
+// percentiles, queue counters and the cache and prefetch hit rates. Returns the process exit code if the server cannot start.
+int run_tile_server(Renderer& renderer, const TileServerOptions& options);
+
+}
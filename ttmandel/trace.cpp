@@ -0,0 +1,98 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ttmandel {
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    int64_t id;
+    double ts_us;
+    double dur_us;
+};
+
+// Each thread appends to its own buffer, so zones on different threads never contend. Buffers are owned by the
+// registry because threads (e.g. tile server connections) may exit before the trace is written.
+struct ThreadBuffer {
+    std::mutex mutex;
+    long tid;
+    std::vector<TraceEvent> events;
+};
+
+std::atomic<bool> tracing{false};
+std::chrono::steady_clock::time_point trace_start;
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+ThreadBuffer& thread_buffer() {
+    thread_local ThreadBuffer* buffer = [] {
+        auto b = std::make_unique<ThreadBuffer>();
+        b->tid = syscall(SYS_gettid);
+        std::lock_guard lock(registry_mutex);
+        registry.push_back(std::move(b));
+        return registry.back().get();
+    }();
+    return *buffer;
+}
+
+double micros(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+}
+
+void start_trace() {
+    trace_start = std::chrono::steady_clock::now();
+    tracing = true;
+}
+
+bool write_trace(const std::string& path) {
+    std::ofstream out(path);
+    if(!out)
+        return false;
+    const long pid = getpid();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    std::lock_guard lock(registry_mutex);
+    for(const auto& buffer : registry) {
+        std::lock_guard buffer_lock(buffer->mutex);
+        for(const TraceEvent& e : buffer->events) {
+            out << (first ? "" : ",\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": " << pid
+                << ", \"tid\": " << buffer->tid << ", \"ts\": " << e.ts_us << ", \"dur\": " << e.dur_us;
+            if(e.id >= 0)
+                out << ", \"args\": {\"id\": " << e.id << "}";
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return bool(out);
+}
+
+TraceZone::TraceZone(const char* name, int64_t id)
+    : name(name), id(id), active(tracing.load(std::memory_order_relaxed)) {
+    if(active)
+        start = std::chrono::steady_clock::now();
+}
+
+TraceZone::~TraceZone() {
+    if(!active)
+        return;
+    auto end = std::chrono::steady_clock::now();
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard lock(buffer.mutex);
+    buffer.events.push_back({name, id, micros(start - trace_start), micros(end - start)});
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#ifdef TRACY_ENABLE
+#include <tracy/Tracy.hpp>
+#endif
+
+namespace ttmandel {
+
+// Timeline of the render pipeline in Chrome trace-event format, viewable in chrome://tracing or Perfetto. Zones
+// cost a single flag check while tracing is off. Builds with TRACY_ENABLE also send every zone to Tracy.
+
+// Starts recording zones from every thread
+void start_trace();
+// Writes every zone recorded so far to `path`. Returns false if the file cannot be written.
+bool write_trace(const std::string& path);
+
+class TraceZone {
+public:
+    // `name` must outlive the trace, i.e. be a string literal. `id` (row, band, tile, job, ...) shows up in the
+    // zone's args when it is not negative.
+    explicit TraceZone(const char* name, int64_t id = -1);
+    ~TraceZone();
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+    const char* name;
+    int64_t id;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
+
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef TRACY_ENABLE
+// Named per line, so that a scope can hold more than one zone
+#define TRACE_ZONE(name) ZoneNamedN(TRACE_CONCAT(tracy_zone_, __LINE__), name, true); \
+    ::ttmandel::TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_ZONE_ID(name, id) ZoneNamedN(TRACE_CONCAT(tracy_zone_, __LINE__), name, true); \
+    ZoneValueV(TRACE_CONCAT(tracy_zone_, __LINE__), uint64_t(id)); \
+    ::ttmandel::TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name, id)
+#else
+#define TRACE_ZONE(name) ::ttmandel::TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_ZONE_ID(name, id) ::ttmandel::TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name, id)
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Classes of large buffers whose bytes are tracked process-wide
+enum class MemoryClass {
+    // Frame planes
+    Iterations,
+    Distance,
+    // Colorized images
+    Rgb,
+    // libpng row pointer tables
+    PngRows,
+    // Host side staging and readback buffers of device backends
+    Device,
+};
+constexpr size_t memory_class_count = 5;
+constexpr const char* memory_class_names[memory_class_count] = {
+    "iterations", "distance", "rgb", "png_rows", "device"};
+
+// Live bytes of every class, and the high-water mark of each and of their sum since the last reset_memory_peaks()
+struct MemoryCounters {
+    std::array<std::atomic<size_t>, memory_class_count> current{};
+    std::array<std::atomic<size_t>, memory_class_count> peak{};
+    std::atomic<size_t> total{0};
+    std::atomic<size_t> total_peak{0};
+};
+
+inline MemoryCounters memory_counters;
+
+inline void raise_peak(std::atomic<size_t>& peak, size_t value) {
+    size_t seen = peak.load(std::memory_order_relaxed);
+    while(value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+}
+
+inline void track_allocation(MemoryClass type, size_t bytes) {
+    const size_t i = size_t(type);
+    raise_peak(memory_counters.peak[i], memory_counters.current[i].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    raise_peak(memory_counters.total_peak, memory_counters.total.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+inline void track_release(MemoryClass type, size_t bytes) {
+    memory_counters.current[size_t(type)].fetch_sub(bytes, std::memory_order_relaxed);
+    memory_counters.total.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+// Starts new high-water marks from the bytes live now
+inline void reset_memory_peaks() {
+    for(size_t i = 0; i < memory_class_count; ++i)
+        memory_counters.peak[i].store(memory_counters.current[i].load(std::memory_order_relaxed));
+    memory_counters.total_peak.store(memory_counters.total.load(std::memory_order_relaxed));
+}
+
+// std::allocator that adds every allocation to the counters of `Class`
+template <typename T, MemoryClass Class>
+struct CountingAllocator {
+    using value_type = T;
+    // Spelled out because the non-type parameter keeps std::allocator_traits from deducing it
+    template <typename U>
+    struct rebind {
+        using other = CountingAllocator<U, Class>;
+    };
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U, Class>&) {}
+
+    T* allocate(size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        track_allocation(Class, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) {
+        track_release(Class, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    friend bool operator==(const CountingAllocator&, const CountingAllocator&) { return true; }
+};
+
+template <typename T, MemoryClass Class>
+using CountedVector = std::vector<T, CountingAllocator<T, Class>>;
+
+using RgbBuffer = CountedVector<uint8_t, MemoryClass::Rgb>;
+
+// Accounts for a buffer whose type is fixed by someone else's API, by the size it is told
+class TrackedBytes {
+public:
+    explicit TrackedBytes(MemoryClass type) : type(type) {}
+    ~TrackedBytes() { set(0); }
+
+    TrackedBytes(const TrackedBytes&) = delete;
+    TrackedBytes& operator=(const TrackedBytes&) = delete;
+
+    void set(size_t new_bytes) {
+        if(new_bytes > bytes)
+            track_allocation(type, new_bytes - bytes);
+        else if(new_bytes < bytes)
+            track_release(type, bytes - new_bytes);
+        bytes = new_bytes;
+    }
+
+private:
+    MemoryClass type;
+    size_t bytes = 0;
+};